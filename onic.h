@@ -22,17 +22,41 @@
 #include <linux/bpf.h>
 #include <net/xdp.h>
 #include <linux/bitops.h>
+#include <linux/version.h>
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 3, 0)
+#include <linux/dim.h>
+#endif
 
 #include "onic_hardware.h"
 
 #define ONIC_MAX_QUEUES			64
 
+/* default ring sizes as indexes into the ring count pool */
+#define ONIC_DEFAULT_TX_RNGCNT_IDX	0
+#define ONIC_DEFAULT_RX_RNGCNT_IDX	8
+#define ONIC_DEFAULT_CMPL_RNGCNT_IDX	8
+#define ONIC_MAX_RING_COUNT		16384
+
+/* largest frame accepted by the CMAC, FCS included */
+#define ONIC_MAX_FRAME_LEN		9600
+#define ONIC_MAX_MTU			(ONIC_MAX_FRAME_LEN - ETH_HLEN - ETH_FCS_LEN)
+
+/* RX packets up to this length are copied into a new skb */
+#define ONIC_RX_COPYBREAK		256
+#define ONIC_MAX_RX_COPYBREAK		1024
+
 /* state bits */
 #define ONIC_ERROR_INTR			0
 #define ONIC_USER_INTR			1
+#define ONIC_XDP_TX_QUEUES		2
+#define ONIC_DOWN			3
 
 /* flag bits */
 #define ONIC_FLAG_MASTER_PF		0
+#define ONIC_FLAG_INTR_AGGR		1
+
+/* each queue vector owns a 4KB interrupt aggregation ring */
+#define ONIC_INTR_RING_SIZE		4096
 
 /* XDP */
 #define ONIC_XDP_PASS    	BIT(0)	
@@ -40,12 +64,39 @@
 #define ONIC_XDP_TX       	BIT(2)
 #define ONIC_XDP_REDIR    	BIT(3)
 
+/* XDP_TX frames held per RX queue before the H2C ring is written */
+#define ONIC_XDP_TX_BULK_SIZE	64
+
 enum onic_tx_buf_type {
 	ONIC_TX_SKB = BIT(0),
 	ONIC_TX_XDPF = BIT(1),
 	ONIC_TX_XDPF_XMIT = BIT(2),
+	ONIC_TX_XSK = BIT(3),
+	ONIC_TX_SKB_FRAG = BIT(4),
+	ONIC_TX_TSO_HDR = BIT(5),
+	ONIC_TX_BOUNCE = BIT(6),
 };
 
+/* every TX descriptor owns a coherent slot, holding either the headers of a
+ * TSO segment or a copied small packet.  Slots are allocated a page at a time.
+ */
+#define ONIC_TX_SLOT_SIZE		256
+#define ONIC_TX_SLOTS_PER_PAGE		(PAGE_SIZE / ONIC_TX_SLOT_SIZE)
+
+/* TX packets up to this length are copied into the descriptor slot */
+#define ONIC_TX_COPYBREAK		128
+
+/* TSO and UDP GSO skbs are limited to this many segments */
+#define ONIC_TSO_MAX_SEGS		64
+
+/* descriptors taken by the largest skb: a header and at least one payload
+ * descriptor per segment, plus one more for each frag boundary
+ */
+#define ONIC_TX_DESCS_NEEDED		(ONIC_TSO_MAX_SEGS * 2 + MAX_SKB_FRAGS + 1)
+
+/* a stopped TX queue is woken once this many descriptors are free */
+#define ONIC_TX_WAKE_THRESH		(2 * ONIC_TX_DESCS_NEEDED)
+
 struct onic_tx_buffer {
 	enum onic_tx_buf_type type;
 	union {
@@ -54,11 +105,15 @@ struct onic_tx_buffer {
 	};
 	dma_addr_t dma_addr;
 	u32 len;
+	/* wire bytes and packets of the skb on its last descriptor, for BQL */
+	u32 bytecount;
+	u16 gso_segs;
 	u64 time_stamp;
 };
 
 struct onic_rx_buffer {
 	struct page *pg;
+	struct xdp_buff *xdp;	/* AF_XDP zero-copy buffer */
 	unsigned int offset;
 	u64 time_stamp;
 };
@@ -77,15 +132,33 @@ struct onic_ring {
 	u8 color;
 };
 
+struct onic_tx_slot_page {
+	u8 *va;
+	dma_addr_t dma_addr;
+};
+
 struct onic_tx_queue {
 	struct net_device *netdev;
 	u16 qid;
-	DECLARE_BITMAP(state, 32);
 
 	struct onic_tx_buffer *buffer;
 	struct onic_ring ring;
 	struct onic_q_vector *vector;
 
+	struct napi_struct napi;
+	struct xsk_buff_pool *xsk_pool;
+
+	/* one ONIC_TX_SLOT_SIZE slot per descriptor */
+	struct onic_tx_slot_page *slot_pages;
+	u16 num_slot_pages;
+
+	/* dedicated XDP queues are cleaned by their producer, and only locked
+	 * when CPUs share them
+	 */
+	bool xdp;
+	bool xdp_locked;
+	spinlock_t xdp_lock;
+
 	struct {
 		u64	xdp_xmit;
 		u64	xdp_xmit_err;
@@ -97,6 +170,10 @@ struct onic_rx_queue {
 	u16 qid;
 
 	struct onic_rx_buffer *buffer;
+	u16 bufsz;
+	bool page_frag;
+	u8 cmpl_desc_sz;
+	struct onic_qdma_cmpl_coal coal;
 	struct onic_ring desc_ring;
 	struct onic_ring cmpl_ring;
 	struct onic_q_vector *vector;
@@ -105,6 +182,19 @@ struct onic_rx_queue {
 	struct bpf_prog *xdp_prog;
 	struct xdp_rxq_info xdp_rxq;
 	struct page_pool *page_pool;
+	struct xsk_buff_pool *xsk_pool;
+
+	struct xdp_frame *xdp_tx_bulk[ONIC_XDP_TX_BULK_SIZE];
+	u16 xdp_tx_bulk_count;
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 3, 0)
+	struct dim dim;
+#endif
+	struct {
+		u64 packets;
+		u64 bytes;
+		u16 events;
+	} dim_stats;
 
 	struct {
 		u64 xdp_redirect;
@@ -121,6 +211,9 @@ struct onic_q_vector {
 	struct onic_private *priv;
 	struct cpumask affinity_mask;
 	int numa_node;
+
+	/* queues interrupting this vector, in aggregation mode */
+	struct onic_ring intr_ring;
 };
 
 
@@ -135,13 +228,25 @@ struct onic_private {
 	DECLARE_BITMAP(flags, 32);
 
         int RS_FEC;
+	u8 cmpl_desc_sz;
+	u32 rx_copybreak;
+	u32 tx_copybreak;
+	u8 tx_rngcnt_idx;
+	u8 rx_rngcnt_idx;
+	u8 cmpl_rngcnt_idx;
+	struct onic_qdma_cmpl_coal rx_coal;
+	bool rx_dim_enabled;
 
 	u16 num_q_vectors;
 	u16 num_tx_queues;
 	u16 num_rx_queues;
+	u16 num_xdp_queues;
+	u16 xdp_qbase;
 
 	struct net_device *netdev;
 	struct bpf_prog *xdp_prog;
+	DECLARE_BITMAP(af_xdp_zc_qps, ONIC_MAX_QUEUES);
+	DECLARE_BITMAP(xps_init_done, ONIC_MAX_QUEUES);
 	struct rtnl_link_stats64 *netdev_stats;
 	spinlock_t tx_lock;
 	spinlock_t rx_lock;
@@ -149,6 +254,7 @@ struct onic_private {
 	struct onic_q_vector *q_vector[ONIC_MAX_QUEUES];
 	struct onic_tx_queue *tx_queue[ONIC_MAX_QUEUES];
 	struct onic_rx_queue *rx_queue[ONIC_MAX_QUEUES];
+	struct onic_tx_queue *xdp_tx_queue[ONIC_MAX_QUEUES];
 
 	struct onic_hardware hw;
 };
@@ -21,6 +21,7 @@
 #include <linux/version.h>
 
 #include "onic.h"
+#include "onic_netdev.h"
 #include "onic_register.h"
 
 extern const char onic_drv_name[];
@@ -345,6 +346,12 @@ static void onic_get_ethtool_stats(struct net_device *netdev,
         global_xdp_stats.xdp_xmit += priv->tx_queue[j]->xdp_tx_stats.xdp_xmit;
         global_xdp_stats.xdp_xmit_err += priv->tx_queue[j]->xdp_tx_stats.xdp_xmit_err;
       }
+      for (j =0; j < priv->num_xdp_queues; j++) {
+        if (!priv->xdp_tx_queue[j])
+          continue;
+        global_xdp_stats.xdp_xmit += priv->xdp_tx_queue[j]->xdp_tx_stats.xdp_xmit;
+        global_xdp_stats.xdp_xmit_err += priv->xdp_tx_queue[j]->xdp_tx_stats.xdp_xmit_err;
+      }
     
     func_id = PCI_FUNC(pdev->devfn);
 
@@ -515,8 +522,335 @@ static int onic_get_rxnfc(struct net_device *dev, struct ethtool_rxnfc *info, u3
 	}
 }
 
+static int onic_get_tunable(struct net_device *dev,
+			    const struct ethtool_tunable *tuna, void *data)
+{
+	struct onic_private *priv = netdev_priv(dev);
+
+	switch (tuna->id) {
+	case ETHTOOL_RX_COPYBREAK:
+		*(u32 *)data = priv->rx_copybreak;
+		return 0;
+	case ETHTOOL_TX_COPYBREAK:
+		*(u32 *)data = priv->tx_copybreak;
+		return 0;
+	default:
+		return -EOPNOTSUPP;
+	}
+}
+
+static int onic_set_tunable(struct net_device *dev,
+			    const struct ethtool_tunable *tuna,
+			    const void *data)
+{
+	struct onic_private *priv = netdev_priv(dev);
+	u32 val;
+
+	switch (tuna->id) {
+	case ETHTOOL_RX_COPYBREAK:
+		val = *(const u32 *)data;
+		if (val > ONIC_MAX_RX_COPYBREAK)
+			return -EINVAL;
+		WRITE_ONCE(priv->rx_copybreak, val);
+		return 0;
+	case ETHTOOL_TX_COPYBREAK:
+		val = *(const u32 *)data;
+		if (val > ONIC_TX_SLOT_SIZE)
+			return -EINVAL;
+		WRITE_ONCE(priv->tx_copybreak, val);
+		return 0;
+	default:
+		return -EOPNOTSUPP;
+	}
+}
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 17, 0)
+static void onic_get_ringparam(struct net_device *dev,
+			       struct ethtool_ringparam *ring,
+			       struct kernel_ethtool_ringparam *kernel_ring,
+			       struct netlink_ext_ack *extack)
+#else
+static void onic_get_ringparam(struct net_device *dev,
+			       struct ethtool_ringparam *ring)
+#endif
+{
+	struct onic_private *priv = netdev_priv(dev);
+
+	/* one entry of each ring holds the status writeback */
+	ring->rx_max_pending = ONIC_MAX_RING_COUNT - 1;
+	ring->rx_mini_max_pending = ONIC_MAX_RING_COUNT - 1;
+	ring->tx_max_pending = ONIC_MAX_RING_COUNT - 1;
+	ring->rx_pending = onic_ring_count(priv->rx_rngcnt_idx) - 1;
+	ring->rx_mini_pending = onic_ring_count(priv->cmpl_rngcnt_idx) - 1;
+	ring->tx_pending = onic_ring_count(priv->tx_rngcnt_idx) - 1;
+}
+
+/**
+ * onic_set_ringparam - resize the TX, RX descriptor and completion rings
+ *
+ * Ring sizes are limited to the ring count pool, so each request is rounded up
+ * to the next size in the pool.  The completion ring is reported as the RX
+ * mini ring and may not be smaller than the RX descriptor ring.  Queues are
+ * re-created if the device is running.
+ **/
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 17, 0)
+static int onic_set_ringparam(struct net_device *dev,
+			      struct ethtool_ringparam *ring,
+			      struct kernel_ethtool_ringparam *kernel_ring,
+			      struct netlink_ext_ack *extack)
+#else
+static int onic_set_ringparam(struct net_device *dev,
+			      struct ethtool_ringparam *ring)
+#endif
+{
+	struct onic_private *priv = netdev_priv(dev);
+	bool running = netif_running(dev);
+	int tx_idx, rx_idx, cmpl_idx;
+	u8 old_tx_idx, old_rx_idx, old_cmpl_idx;
+	int rv;
+
+	if (ring->rx_jumbo_pending)
+		return -EINVAL;
+
+	tx_idx = onic_ring_count_idx(ring->tx_pending + 1);
+	rx_idx = onic_ring_count_idx(ring->rx_pending + 1);
+	cmpl_idx = onic_ring_count_idx(ring->rx_mini_pending + 1);
+	if (tx_idx < 0 || rx_idx < 0 || cmpl_idx < 0)
+		return -EINVAL;
+
+	if (onic_ring_count(cmpl_idx) < onic_ring_count(rx_idx)) {
+		netdev_err(dev, "Completion ring smaller than RX ring");
+		return -EINVAL;
+	}
+
+	/* a stopped TX queue must be able to reach its wake threshold, with
+	 * the writeback entry and one empty descriptor left out
+	 */
+	if (onic_ring_count(tx_idx) - 2 < ONIC_TX_WAKE_THRESH) {
+		netdev_err(dev, "TX ring smaller than %d",
+			   ONIC_TX_WAKE_THRESH + 2);
+		return -EINVAL;
+	}
+
+	if (onic_ring_count(tx_idx) == onic_ring_count(priv->tx_rngcnt_idx) &&
+	    onic_ring_count(rx_idx) == onic_ring_count(priv->rx_rngcnt_idx) &&
+	    onic_ring_count(cmpl_idx) == onic_ring_count(priv->cmpl_rngcnt_idx))
+		return 0;
+
+	netdev_info(dev, "Ring sizes: TX %d, RX %d, completion %d",
+		    onic_ring_count(tx_idx), onic_ring_count(rx_idx),
+		    onic_ring_count(cmpl_idx));
+
+	old_tx_idx = priv->tx_rngcnt_idx;
+	old_rx_idx = priv->rx_rngcnt_idx;
+	old_cmpl_idx = priv->cmpl_rngcnt_idx;
+
+	if (running)
+		onic_stop_netdev(dev);
+	priv->tx_rngcnt_idx = tx_idx;
+	priv->rx_rngcnt_idx = rx_idx;
+	priv->cmpl_rngcnt_idx = cmpl_idx;
+	if (!running)
+		return 0;
+
+	rv = onic_open_netdev(dev);
+	if (rv < 0) {
+		netdev_err(dev, "Failed to resize rings, err = %d", rv);
+		priv->tx_rngcnt_idx = old_tx_idx;
+		priv->rx_rngcnt_idx = old_rx_idx;
+		priv->cmpl_rngcnt_idx = old_cmpl_idx;
+		onic_open_netdev(dev);
+	}
+
+	return rv;
+}
+
+static void onic_get_channels(struct net_device *dev,
+			      struct ethtool_channels *ch)
+{
+	struct onic_private *priv = netdev_priv(dev);
+
+	/* TX and RX queues are paired on queue vectors, which aggregate the
+	 * interrupts of several pairs when vectors are short
+	 */
+	ch->max_combined = test_bit(ONIC_FLAG_INTR_AGGR, priv->flags) ?
+			   ONIC_MAX_QUEUES : priv->num_q_vectors;
+	ch->combined_count = priv->num_rx_queues;
+}
+
+/**
+ * onic_apply_channels - set up the function for a number of queues
+ * @dev: pointer to network device
+ * @tx_count: number of TX queues
+ * @rx_count: number of RX queues
+ *
+ * Queues must be cleared.  Return 0 on success, negative on failure
+ **/
+static int onic_apply_channels(struct net_device *dev, u16 tx_count,
+			       u16 rx_count)
+{
+	struct onic_private *priv = netdev_priv(dev);
+	int rv;
+
+	priv->num_tx_queues = tx_count;
+	priv->num_rx_queues = rx_count;
+	rv = onic_init_queue_map(priv);
+	if (rv < 0) {
+		netdev_err(dev, "onic_init_queue_map, err = %d", rv);
+		return rv;
+	}
+	if (!netif_is_rxfh_configured(dev))
+		onic_init_indir_table(priv);
+
+	rv = netif_set_real_num_tx_queues(dev, tx_count);
+	if (rv < 0)
+		return rv;
+	rv = netif_set_real_num_rx_queues(dev, rx_count);
+	if (rv < 0)
+		return rv;
+	/* XPS maps follow the vectors of the new queues on the next open */
+	bitmap_zero(priv->xps_init_done, ONIC_MAX_QUEUES);
+
+	return 0;
+}
+
+/**
+ * onic_set_channels - change the number of queue pairs
+ *
+ * The QDMA function map, the shell queue configuration, the XPS maps and,
+ * unless configured by the user, the RSS indirection table are reprogrammed for
+ * the new count.
+ * Queues are re-created if the device is running.  On failure, the previous
+ * configuration is restored.
+ **/
+static int onic_set_channels(struct net_device *dev,
+			     struct ethtool_channels *ch)
+{
+	struct onic_private *priv = netdev_priv(dev);
+	bool running = netif_running(dev);
+	u16 count = ch->combined_count;
+	u16 max_count = test_bit(ONIC_FLAG_INTR_AGGR, priv->flags) ?
+			ONIC_MAX_QUEUES : priv->num_q_vectors;
+	u16 old_tx_count = priv->num_tx_queues;
+	u16 old_rx_count = priv->num_rx_queues;
+	int rv;
+
+	if (ch->rx_count || ch->tx_count || ch->other_count)
+		return -EINVAL;
+	if (!count || count > max_count)
+		return -EINVAL;
+	if (count == priv->num_tx_queues && count == priv->num_rx_queues)
+		return 0;
+
+	netdev_info(dev, "Number of queues = %d", count);
+
+	if (running)
+		onic_stop_netdev(dev);
+
+	rv = onic_apply_channels(dev, count, count);
+	if (!rv && running)
+		rv = onic_open_netdev(dev);
+	if (rv < 0) {
+		netdev_err(dev, "Failed to set %d channels, err = %d", count,
+			   rv);
+		onic_apply_channels(dev, old_tx_count, old_rx_count);
+		if (running)
+			onic_open_netdev(dev);
+	}
+
+	return rv;
+}
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 15, 0)
+static int onic_get_coalesce(struct net_device *dev,
+			     struct ethtool_coalesce *ec,
+			     struct kernel_ethtool_coalesce *kernel_coal,
+			     struct netlink_ext_ack *extack)
+#else
+static int onic_get_coalesce(struct net_device *dev,
+			     struct ethtool_coalesce *ec)
+#endif
+{
+	struct onic_private *priv = netdev_priv(dev);
+	struct onic_qdma_cmpl_coal *coal = &priv->rx_coal;
+
+	switch (coal->trig_mode) {
+	case QDMA_CMPL_TRIG_USER_TIMER_COUNT:
+		ec->rx_coalesce_usecs = onic_c2h_timer_usecs(coal->timer_idx);
+		ec->rx_max_coalesced_frames = onic_c2h_thres(coal->counter_idx);
+		break;
+	case QDMA_CMPL_TRIG_USER_TIMER:
+		ec->rx_coalesce_usecs = onic_c2h_timer_usecs(coal->timer_idx);
+		break;
+	case QDMA_CMPL_TRIG_USER_COUNT:
+		ec->rx_max_coalesced_frames = onic_c2h_thres(coal->counter_idx);
+		break;
+	default:
+		ec->rx_max_coalesced_frames = 1;
+		break;
+	}
+	ec->use_adaptive_rx_coalesce = priv->rx_dim_enabled;
+
+	return 0;
+}
+
+/**
+ * onic_set_coalesce - set RX interrupt moderation
+ *
+ * rx-usecs and rx-frames are mapped onto the closest entries of the C2H timer
+ * and counter threshold pools.  A zero value disables the respective trigger,
+ * and with both disabled every completion raises an interrupt.  The new
+ * setting takes effect with the next completion ring update of each queue.
+ * With adaptive-rx on, net_dim overrides them at run time.
+ **/
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 15, 0)
+static int onic_set_coalesce(struct net_device *dev,
+			     struct ethtool_coalesce *ec,
+			     struct kernel_ethtool_coalesce *kernel_coal,
+			     struct netlink_ext_ack *extack)
+#else
+static int onic_set_coalesce(struct net_device *dev,
+			     struct ethtool_coalesce *ec)
+#endif
+{
+	struct onic_private *priv = netdev_priv(dev);
+	struct onic_qdma_cmpl_coal coal = {};
+	u32 usecs = ec->rx_coalesce_usecs;
+	u32 frames = ec->rx_max_coalesced_frames;
+	int qid;
+
+#if LINUX_VERSION_CODE < KERNEL_VERSION(5, 3, 0)
+	if (ec->use_adaptive_rx_coalesce)
+		return -EOPNOTSUPP;
+#endif
+
+	if (usecs && frames > 1)
+		coal.trig_mode = QDMA_CMPL_TRIG_USER_TIMER_COUNT;
+	else if (usecs)
+		coal.trig_mode = QDMA_CMPL_TRIG_USER_TIMER;
+	else if (frames > 1)
+		coal.trig_mode = QDMA_CMPL_TRIG_USER_COUNT;
+	else
+		coal.trig_mode = QDMA_CMPL_TRIG_EVERY;
+	coal.timer_idx = onic_c2h_timer_idx(usecs);
+	coal.counter_idx = onic_c2h_thres_idx(frames);
+
+	priv->rx_coal = coal;
+	WRITE_ONCE(priv->rx_dim_enabled, !!ec->use_adaptive_rx_coalesce);
+	for (qid = 0; qid < priv->num_rx_queues; ++qid) {
+		if (priv->rx_queue[qid])
+			WRITE_ONCE(priv->rx_queue[qid]->coal, coal);
+	}
+
+	return 0;
+}
 
 static const struct ethtool_ops onic_ethtool_ops = {
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 7, 0)
+    .supported_coalesce_params = ETHTOOL_COALESCE_RX_USECS |
+                                 ETHTOOL_COALESCE_RX_MAX_FRAMES |
+                                 ETHTOOL_COALESCE_USE_ADAPTIVE_RX,
+#endif
     .get_drvinfo         = onic_get_drvinfo,
     .get_link            = onic_get_link,
     .get_ethtool_stats   = onic_get_ethtool_stats,
@@ -532,6 +866,14 @@ static const struct ethtool_ops onic_ethtool_ops = {
     .set_rxfh            = onic_set_rxfh,
 #endif
     .get_rxnfc           = onic_get_rxnfc,
+    .get_tunable         = onic_get_tunable,
+    .set_tunable         = onic_set_tunable,
+    .get_ringparam       = onic_get_ringparam,
+    .set_ringparam       = onic_set_ringparam,
+    .get_channels        = onic_get_channels,
+    .set_channels        = onic_set_channels,
+    .get_coalesce        = onic_get_coalesce,
+    .set_coalesce        = onic_set_coalesce,
 };
 
 void onic_set_ethtool_ops(struct net_device *netdev)
@@ -39,6 +39,9 @@
 #define DEFAULT_THROT_EN_REQ			0
 #define DEFAULT_H2C_THROT_REQ_THRES		0x60
 
+/* 1 C2H timer tick = DEFAULT_C2H_INTR_TIMER_TICK cycles of 4ns */
+#define C2H_TIMER_TICK_NS			(DEFAULT_C2H_INTR_TIMER_TICK * 4)
+
 #define RX_ALIGN_TIMEOUT_MS			1000
 #define CMAC_RESET_WAIT_MS			1
 
@@ -67,6 +70,91 @@ u16 onic_ring_count(u8 idx)
 	return (idx < QDMA_NUM_DESC_RNGCNT) ? rngcnt_pool[idx] : 0;
 }
 
+int onic_ring_count_idx(u32 count)
+{
+	int i, idx = -EINVAL;
+
+	for (i = 0; i < QDMA_NUM_DESC_RNGCNT; ++i) {
+		if (rngcnt_pool[i] < count)
+			continue;
+		if (idx < 0 || rngcnt_pool[i] < rngcnt_pool[idx])
+			idx = i;
+	}
+
+	return idx;
+}
+
+u16 onic_c2h_bufsz(u8 idx)
+{
+	return (idx < QDMA_NUM_C2H_BUFSZ) ? c2h_bufsz_pool[idx] : 0;
+}
+
+int onic_c2h_bufsz_idx(u32 len, u32 max_len)
+{
+	int i, idx = -EINVAL;
+
+	for (i = 0; i < QDMA_NUM_C2H_BUFSZ; ++i) {
+		u16 sz = c2h_bufsz_pool[i];
+		u16 cur;
+
+		if (sz > max_len)
+			continue;
+		if (idx < 0) {
+			idx = i;
+			continue;
+		}
+
+		/* prefer the smallest size holding len, otherwise the largest */
+		cur = c2h_bufsz_pool[idx];
+		if ((cur >= len) ? (sz >= len && sz < cur) : (sz > cur))
+			idx = i;
+	}
+
+	return idx;
+}
+
+static int onic_pool_closest_idx(const u16 *pool, int n, u32 val)
+{
+	u32 diff, best = U32_MAX;
+	int i, idx = 0;
+
+	for (i = 0; i < n; ++i) {
+		diff = (pool[i] > val) ? pool[i] - val : val - pool[i];
+		if (diff < best) {
+			best = diff;
+			idx = i;
+		}
+	}
+
+	return idx;
+}
+
+u32 onic_c2h_timer_usecs(u8 idx)
+{
+	if (idx >= QDMA_NUM_C2H_TIMERS)
+		return 0;
+	return DIV_ROUND_CLOSEST(c2h_timer_pool[idx] * C2H_TIMER_TICK_NS, 1000);
+}
+
+int onic_c2h_timer_idx(u32 usecs)
+{
+	u32 ticks = min_t(u32, usecs, U16_MAX) * 1000 / C2H_TIMER_TICK_NS;
+
+	return onic_pool_closest_idx(c2h_timer_pool, QDMA_NUM_C2H_TIMERS,
+				     ticks);
+}
+
+u16 onic_c2h_thres(u8 idx)
+{
+	return (idx < QDMA_NUM_C2H_COUNTERS) ? c2h_thres_pool[idx] : 0;
+}
+
+int onic_c2h_thres_idx(u32 count)
+{
+	return onic_pool_closest_idx(c2h_thres_pool, QDMA_NUM_C2H_COUNTERS,
+				     count);
+}
+
 /**
  * onic_qdma_init_csr - initialize QDMA config/status registers
  * @qdev: pointer to QDMA device
@@ -222,32 +310,26 @@ static int onic_enable_cmac(struct onic_hardware *hw, u8 cmac_id)
 	return 0;
 }
 
-int onic_init_hardware(struct onic_private *priv)
+int onic_init_queue_map(struct onic_private *priv)
 {
 	struct onic_hardware *hw = &priv->hw;
-	struct pci_dev *pdev = priv->pdev;
-	struct qdma_dev *qdev;
+	struct qdma_dev *qdev = (struct qdma_dev *)hw->qdma;
 	struct qdma_fmap_ctxt fmap_ctxt;
 	u16 qbase, qmax, func_id;
 	u32 val;
-	u8 master_pf = test_bit(ONIC_FLAG_MASTER_PF, priv->flags);
-	int i, rv;
-
-    priv->hw.RS_FEC = priv->RS_FEC;
-
-	/* shell registers uses BAR-2 */
-	hw->addr = pci_iomap_range(pdev, 2, SHELL_START, SHELL_MAXLEN);
-	if (!hw->addr)
-		return -EINVAL;
-
-	/* QDMA IP registers uses BAR-0 */
-	qdev = qdma_create_dev(pdev, 0);
-	if (!qdev)
-		return -ENOMEM;
+	int rv;
 
-	func_id = PCI_FUNC(pdev->devfn);
+	func_id = PCI_FUNC(priv->pdev->devfn);
 	qbase = func_id * ONIC_MAX_QUEUES;
-	qmax = max(priv->num_tx_queues, priv->num_rx_queues);
+	hw->qbase = qbase;
+
+	/* XDP TX queues follow the stack queues, one per online CPU as far as
+	 * the queue range of the function allows
+	 */
+	priv->xdp_qbase = max(priv->num_tx_queues, priv->num_rx_queues);
+	priv->num_xdp_queues = min_t(u16, num_online_cpus(),
+				     ONIC_MAX_QUEUES - priv->xdp_qbase);
+	qmax = priv->xdp_qbase + priv->num_xdp_queues;
 
 	/* initialize QDMA function map context */
 	memset(&fmap_ctxt, 0, sizeof(struct qdma_fmap_ctxt));
@@ -255,29 +337,65 @@ int onic_init_hardware(struct onic_private *priv)
 	fmap_ctxt.qmax = qmax;
 	rv = qdma_clear_fmap_ctxt(qdev);
 	if (rv < 0)
-		goto clear_hardware;
+		return rv;
 	rv = qdma_write_fmap_ctxt(qdev, &fmap_ctxt);
 	if (rv < 0)
-		goto clear_hardware;
+		return rv;
 
 	/* inform shell about the function map */
 	val = (FIELD_SET(QDMA_FUNC_QCONF_QBASE_MASK, qbase) |
 	       FIELD_SET(QDMA_FUNC_QCONF_NUMQ_MASK, qmax));
 	onic_write_reg(hw, QDMA_FUNC_OFFSET_QCONF(func_id), val);
 
-	/* initialize indirection table */
+	return 0;
+}
+
+void onic_init_indir_table(struct onic_private *priv)
+{
+	struct onic_hardware *hw = &priv->hw;
+	u16 func_id = PCI_FUNC(priv->pdev->devfn);
+	int i;
+
 	for (i = 0; i < 128; ++i) {
-		u32 val = (i % qmax) & 0x0000FFFF;
+		u32 val = (i % priv->num_rx_queues) & 0x0000FFFF;
 		u32 offset = QDMA_FUNC_OFFSET_INDIR_TABLE(func_id, i);
 		onic_write_reg(hw, offset, val);
 	}
+}
+
+int onic_init_hardware(struct onic_private *priv)
+{
+	struct onic_hardware *hw = &priv->hw;
+	struct pci_dev *pdev = priv->pdev;
+	struct qdma_dev *qdev;
+	u32 val;
+	u8 master_pf = test_bit(ONIC_FLAG_MASTER_PF, priv->flags);
+	int i, rv;
+
+    priv->hw.RS_FEC = priv->RS_FEC;
+
+	/* shell registers uses BAR-2 */
+	hw->addr = pci_iomap_range(pdev, 2, SHELL_START, SHELL_MAXLEN);
+	if (!hw->addr)
+		return -EINVAL;
+
+	/* QDMA IP registers uses BAR-0 */
+	qdev = qdma_create_dev(pdev, 0);
+	if (!qdev)
+		return -ENOMEM;
+	hw->qdma = (unsigned long)qdev;
+
+	rv = onic_init_queue_map(priv);
+	if (rv < 0)
+		goto clear_hardware;
+
+	/* initialize indirection table */
+	onic_init_indir_table(priv);
 
 	/* initialize global registers if device is a master PF */
 	if (master_pf)
 		onic_qdma_init_csr(qdev);
 
-    hw->qdma = (unsigned long)qdev;
-
 	/* get the number of CMAC instances */
 	for (i = 0; i < ONIC_MAX_CMACS; ++i) {
 		val = onic_read_reg(hw, CMAC_OFFSET_CORE_VERSION(i));
@@ -353,6 +471,60 @@ void onic_qdma_clear_error_interrupt(unsigned long qdma)
 	qdma_write_reg(qdev, QDMA_OFFSET_GLBL_ERR_INT, 0);
 }
 
+/**
+ * onic_qdma_intr_ring_idx - get the global index of an interrupt ring
+ * @qdev: pointer to QDMA device
+ * @vid: vector ID
+ *
+ * Interrupt rings are shared by all functions, and numbered like queues with
+ * ONIC_MAX_QUEUES per function
+ **/
+static u16 onic_qdma_intr_ring_idx(struct qdma_dev *qdev, u16 vid)
+{
+	return qdev->func_id * ONIC_MAX_QUEUES + vid;
+}
+
+bool onic_intr_aggr_supported(struct onic_private *priv, u16 num_vectors)
+{
+	u16 func_id = PCI_FUNC(priv->pdev->devfn);
+	u32 last_idx = func_id * ONIC_MAX_QUEUES + num_vectors - 1;
+
+	/* the ring index field of the interrupt CIDX register is the limit */
+	return num_vectors &&
+	       last_idx <= (QDMA_DMAP_SEL_INTR_RING_IDX_MASK >>
+			    FIELD_SHIFT(QDMA_DMAP_SEL_INTR_RING_IDX_MASK));
+}
+
+int onic_qdma_init_intr_ring(unsigned long qdma, u16 vid, dma_addr_t dma_addr)
+{
+	struct qdma_dev *qdev = (struct qdma_dev *)qdma;
+	u16 ring_idx = onic_qdma_intr_ring_idx(qdev, vid);
+	struct qdma_intr_ctxt intr_ctxt;
+	int rv;
+
+	memset(&intr_ctxt, 0, sizeof(struct qdma_intr_ctxt));
+	intr_ctxt.valid = 1;
+	intr_ctxt.vec = vid;
+	intr_ctxt.color = 1;
+	intr_ctxt.baddr = dma_addr;
+	intr_ctxt.page_size = QDMA_INTR_RNGSZ_4KB;
+
+	rv = qdma_clear_intr_ctxt(qdev, ring_idx);
+	if (rv < 0)
+		return rv;
+	rv = qdma_write_intr_ctxt(qdev, ring_idx, &intr_ctxt);
+	if (rv < 0)
+		qdma_invalidate_intr_ctxt(qdev, ring_idx);
+	return rv;
+}
+
+void onic_qdma_clear_intr_ring(unsigned long qdma, u16 vid)
+{
+	struct qdma_dev *qdev = (struct qdma_dev *)qdma;
+
+	qdma_invalidate_intr_ctxt(qdev, onic_qdma_intr_ring_idx(qdev, vid));
+}
+
 int onic_qdma_init_tx_queue(unsigned long qdma, u16 qid,
 			    const struct onic_qdma_h2c_param *param)
 {
@@ -370,8 +542,8 @@ int onic_qdma_init_tx_queue(unsigned long qdma, u16 qid,
 	sw_ctxt.qen = 1;
 	sw_ctxt.wbk_en = 1;
 	sw_ctxt.is_mm = 0;
-	sw_ctxt.irq_arm = 0;
-	sw_ctxt.irq_en = 0;
+	sw_ctxt.irq_arm = param->irq_en;
+	sw_ctxt.irq_en = param->irq_en;
 	sw_ctxt.desc_sz = 1; /* 1: 16B for H2C stream */
 	sw_ctxt.fcrd_en = 0;
 	sw_ctxt.wbi_chk = 1;
@@ -379,8 +551,10 @@ int onic_qdma_init_tx_queue(unsigned long qdma, u16 qid,
 	sw_ctxt.at = 0;
 	sw_ctxt.rngsz_idx = param->rngcnt_idx;
 	sw_ctxt.desc_base = param->dma_addr;
-	sw_ctxt.vec = param->vid;
-	sw_ctxt.intr_aggr = 0;
+	/* in aggregation mode, the vector field holds the interrupt ring */
+	sw_ctxt.vec = param->intr_aggr ?
+		onic_qdma_intr_ring_idx(qdev, param->vid) : param->vid;
+	sw_ctxt.intr_aggr = param->intr_aggr;
 
 	rv = qdma_clear_sw_ctxt(qdev, qid, dir);
 	if (rv < 0)
@@ -460,10 +634,10 @@ int onic_qdma_init_rx_queue(unsigned long qdma, u16 qid,
 	cmpl_ctxt.stat_en = 1;
 	//cmpl_ctxt.stat_en = 0;
 	cmpl_ctxt.intr_en = 1;
-	cmpl_ctxt.trig_mode = 0x5;
+	cmpl_ctxt.trig_mode = param->coal.trig_mode;
 	cmpl_ctxt.func_id = qdev->func_id;
-	cmpl_ctxt.counter_idx = 0;
-	cmpl_ctxt.timer_idx = 0;
+	cmpl_ctxt.counter_idx = param->coal.counter_idx;
+	cmpl_ctxt.timer_idx = param->coal.timer_idx;
 	cmpl_ctxt.color = 1;
 	cmpl_ctxt.rngsz_idx = param->cmpl_rngcnt_idx;
 	cmpl_ctxt.baddr = param->cmpl_dma_addr;
@@ -471,8 +645,9 @@ int onic_qdma_init_rx_queue(unsigned long qdma, u16 qid,
 	cmpl_ctxt.valid = 1;
 	cmpl_ctxt.full_upd = 0;
 	cmpl_ctxt.ovf_chk_dis = 0;
-	cmpl_ctxt.vec = param->vid;
-	cmpl_ctxt.intr_aggr = 0;
+	cmpl_ctxt.vec = param->intr_aggr ?
+		onic_qdma_intr_ring_idx(qdev, param->vid) : param->vid;
+	cmpl_ctxt.intr_aggr = param->intr_aggr;
 
 	rv = qdma_clear_cmpl_ctxt(qdev, qid);
 	if (rv < 0)
@@ -545,9 +720,25 @@ static void onic_qdma_set_q_pidx(unsigned long qdma, u16 qid,
 	qdma_write_reg(qdev, offset, val);
 }
 
-void onic_set_tx_head(unsigned long qdma, u16 qid, u16 head)
+void onic_set_intr_ring_tail(unsigned long qdma, u16 vid, u16 tail)
+{
+	struct qdma_dev *qdev = (struct qdma_dev *)qdma;
+	u32 offset, val;
+
+	/* the ring is selected by its index in the value, so the register of
+	 * the first queue of the function serves every ring
+	 */
+	offset = QDMA_OFFSET_DMAP_SEL_INTR_CIDX;
+
+	val = (FIELD_SET(QDMA_DMAP_SEL_INTR_SW_CIDX_MASK, tail) |
+	       FIELD_SET(QDMA_DMAP_SEL_INTR_RING_IDX_MASK,
+			 onic_qdma_intr_ring_idx(qdev, vid)));
+	qdma_write_reg(qdev, offset, val);
+}
+
+void onic_set_tx_head(unsigned long qdma, u16 qid, u16 head, u8 irq_arm)
 {
-	onic_qdma_set_q_pidx(qdma, qid, QDMA_H2C, head, 0);
+	onic_qdma_set_q_pidx(qdma, qid, QDMA_H2C, head, irq_arm);
 }
 
 void onic_set_rx_head(unsigned long qdma, u16 qid, u16 head)
@@ -589,12 +780,15 @@ static void onic_qdma_set_cmpl_cidx(unsigned long qdma, u16 qid, u16 cidx,
 	qdma_write_reg(qdev, offset, val);
 }
 
-void onic_set_completion_tail(unsigned long qdma, u16 qid, u16 tail, u8 irq_arm)
+void onic_set_completion_tail(unsigned long qdma, u16 qid, u16 tail,
+			      const struct onic_qdma_cmpl_coal *coal,
+			      u8 irq_arm)
 {
 	struct qdma_dev *qdev = (struct qdma_dev *)qdma;
-	u8 trig_mode = 5; // trigger from: user, count, or timer
 	u8 stat_en = 1;  // enabled is necessary for getting proper completion_status, e.g. for knowing pidx
 	bool debug = 0;
 	if (debug) dev_info(&qdev->pdev->dev, "onic_set_completion_tail (qid:%u, tail:%u, irq_arm:%u)", qid, tail, irq_arm);
-	onic_qdma_set_cmpl_cidx(qdma, qid, tail, 0, 0, trig_mode, stat_en, irq_arm);
+	onic_qdma_set_cmpl_cidx(qdma, qid, tail, coal->counter_idx,
+				coal->timer_idx, coal->trig_mode, stat_en,
+				irq_arm);
 }
@@ -26,6 +26,7 @@ struct onic_hardware {
     int RS_FEC;
 	unsigned long qdma;
 	u8 num_cmacs;
+	u16 qbase;		/* first QDMA queue of the function */
 	void __iomem *addr;	/* mapping of shell registers */
 };
 
@@ -33,16 +34,31 @@ struct onic_qdma_h2c_param {
 	u8 rngcnt_idx;
 	dma_addr_t dma_addr;
 	u16 vid;
+	u8 irq_en;
+	u8 intr_aggr;		/* interrupt through the ring of vector vid */
 };
 
+/* completion interrupt moderation, indexes into the C2H timer and counter
+ * threshold pools.  Sized and aligned to be read and written as one word, as
+ * DIM updates it while NAPI uses it.
+ */
+struct onic_qdma_cmpl_coal {
+	u8 timer_idx;
+	u8 counter_idx;
+	u8 trig_mode;
+	u8 rsvd;
+} __aligned(4);
+
 struct onic_qdma_c2h_param {
 	u8 bufsz_idx;
 	u8 desc_rngcnt_idx;
 	u8 cmpl_rngcnt_idx;
 	u8 cmpl_desc_sz;
+	struct onic_qdma_cmpl_coal coal;
 	dma_addr_t desc_dma_addr;
 	dma_addr_t cmpl_dma_addr;
 	u16 vid;
+	u8 intr_aggr;		/* interrupt through the ring of vector vid */
 };
 
 struct onic_private;
@@ -55,6 +71,68 @@ struct onic_private;
  **/
 u16 onic_ring_count(u8 idx);
 
+/**
+ * onic_ring_count_idx - pick a ring size for a number of descriptors
+ * @count: number of descriptors required
+ *
+ * Return index into the pool of the smallest ring holding @count descriptors,
+ * negative if @count exceeds the largest ring
+ **/
+int onic_ring_count_idx(u32 count);
+
+/**
+ * onic_c2h_bufsz - get the C2H buffer size from index
+ * @idx: index into the pool
+ *
+ * Return the C2H buffer size in bytes pointed at index
+ **/
+u16 onic_c2h_bufsz(u8 idx);
+
+/**
+ * onic_c2h_bufsz_idx - pick a C2H buffer size for a frame length
+ * @len: length of the largest expected frame
+ * @max_len: largest buffer size that fits in an RX buffer
+ *
+ * Among the buffer sizes not exceeding @max_len, pick the smallest one that
+ * holds @len, or the largest one if none does, in which case frames span
+ * several C2H descriptors.
+ *
+ * Return index into the pool on success, negative on failure
+ **/
+int onic_c2h_bufsz_idx(u32 len, u32 max_len);
+
+/**
+ * onic_c2h_timer_usecs - get the C2H interrupt timer value from index
+ * @idx: index into the pool
+ *
+ * Return the timer value in microseconds, rounded to the closest
+ **/
+u32 onic_c2h_timer_usecs(u8 idx);
+
+/**
+ * onic_c2h_timer_idx - pick the C2H interrupt timer closest to a delay
+ * @usecs: delay in microseconds
+ *
+ * Return index into the pool
+ **/
+int onic_c2h_timer_idx(u32 usecs);
+
+/**
+ * onic_c2h_thres - get the C2H counter threshold from index
+ * @idx: index into the pool
+ *
+ * Return the number of completions pointed at index
+ **/
+u16 onic_c2h_thres(u8 idx);
+
+/**
+ * onic_c2h_thres_idx - pick the C2H counter threshold closest to a count
+ * @count: number of completions
+ *
+ * Return index into the pool
+ **/
+int onic_c2h_thres_idx(u32 count);
+
 /**
  * onic_init_hardware - initialize NIC hardware
  * @priv: pointer to driver private data
@@ -69,6 +147,24 @@ int onic_init_hardware(struct onic_private *priv);
  **/
 void onic_clear_hardware(struct onic_private *priv);
 
+/**
+ * onic_init_queue_map - map the active queues of the function
+ * @priv: pointer to driver private data
+ *
+ * Program the QDMA function map context and the shell queue configuration for
+ * the current number of TX and RX queues, followed by the XDP TX queues.
+ * Queues must be cleared.
+ *
+ * Return 0 on success, negative on failure
+ **/
+int onic_init_queue_map(struct onic_private *priv);
+
+/**
+ * onic_init_indir_table - spread the RSS indirection table over RX queues
+ * @priv: pointer to driver private data
+ **/
+void onic_init_indir_table(struct onic_private *priv);
+
 /**
  * onic_qdma_init_error_interrupt - initialize QDMA error interrupt
  * @qdma: handle to QDMA device
@@ -82,6 +178,44 @@ void onic_qdma_init_error_interrupt(unsigned long qdma, u16 vid);
  **/
 void onic_qdma_clear_error_interrupt(unsigned long qdma);
 
+/**
+ * onic_intr_aggr_supported - check if the function may aggregate interrupts
+ * @priv: pointer to driver private data
+ * @num_vectors: number of queue vectors
+ *
+ * Return true if every vector gets an interrupt ring index that the hardware
+ * can address, false otherwise
+ **/
+bool onic_intr_aggr_supported(struct onic_private *priv, u16 num_vectors);
+
+/**
+ * onic_qdma_init_intr_ring - initialize a QDMA interrupt aggregation ring
+ * @qdma: handle to QDMA device
+ * @vid: vector ID
+ * @dma_addr: DMA address of the 4KB ring
+ *
+ * Queues in aggregation mode on vector @vid write an entry to the ring when
+ * they interrupt, and the vector fires until the ring tail catches up.
+ *
+ * Return 0 on success, negative on failure
+ **/
+int onic_qdma_init_intr_ring(unsigned long qdma, u16 vid, dma_addr_t dma_addr);
+
+/**
+ * onic_qdma_clear_intr_ring - invalidate a QDMA interrupt aggregation ring
+ * @qdma: handle to QDMA device
+ * @vid: vector ID
+ **/
+void onic_qdma_clear_intr_ring(unsigned long qdma, u16 vid);
+
+/**
+ * onic_set_intr_ring_tail - set interrupt aggregation ring tail pointer
+ * @qdma: handle to QDMA device
+ * @vid: vector ID
+ * @tail: tail pointer of the interrupt ring, i.e., next_to_clean
+ **/
+void onic_set_intr_ring_tail(unsigned long qdma, u16 vid, u16 tail);
+
 /**
  * onic_qdma_init_tx_queue - initialize a QDMA H2C queue
  * @qdma: handle to QDMA device
@@ -123,8 +257,12 @@ void onic_qdma_clear_rx_queue(unsigned long qdma, u16 qid);
  * @qdma: handle to QDMA device
  * @qid: queue ID
  * @head: head pointer of the TX ring, i.e., next_to_use
+ * @irq_arm: interrupt arm bit for next interrupt generation
+ *
+ * The H2C interrupt is only re-armed once TX NAPI completes, doorbells from
+ * the transmit paths leave it as it is.
  **/
-void onic_set_tx_head(unsigned long qdma, u16 qid, u16 head);
+void onic_set_tx_head(unsigned long qdma, u16 qid, u16 head, u8 irq_arm);
 
 /**
  * onic_set_rx_head - set RX ring head pointer
@@ -139,7 +277,11 @@ void onic_set_rx_head(unsigned long qdma, u16 qid, u16 head);
  * @qdma: handle to QDMA device
  * @qid: queue ID
  * @tail: tail pointer of the RX completion ring, i.e., next_to_clean
+ * @coal: interrupt moderation of the queue
+ * @irq_arm: interrupt arm bit for next interrupt generation
  **/
-void onic_set_completion_tail(unsigned long qdma, u16 qid, u16 tail, u8 irq_arm);
+void onic_set_completion_tail(unsigned long qdma, u16 qid, u16 tail,
+			      const struct onic_qdma_cmpl_coal *coal,
+			      u8 irq_arm);
 
 #endif
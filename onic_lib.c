@@ -29,11 +29,57 @@ static irqreturn_t onic_q_handler(int irq, void *dev_id)
 	struct onic_private *priv = vec->priv;
 	u16 qid = vec->vid;
 	struct onic_rx_queue *rxq = priv->rx_queue[qid];
+	struct onic_tx_queue *txq = priv->tx_queue[qid];
 	bool debug = 0;
 	if (debug) dev_info(&priv->pdev->dev, "queue irq");
 
-	//napi_schedule(&rxq->napi);
-	napi_schedule_irqoff(&rxq->napi);
+	/* C2H and H2C interrupts of a queue pair share the vector */
+	if (rxq)
+		napi_schedule_irqoff(&rxq->napi);
+	if (txq)
+		napi_schedule_irqoff(&txq->napi);
+	return IRQ_HANDLED;
+}
+
+/**
+ * onic_q_aggr_handler - queue interrupt handler in aggregation mode
+ *
+ * Every entry of the interrupt ring names a queue and a direction that fired.
+ * NAPI is scheduled for each, and the ring tail is then returned to QDMA, which
+ * lets the vector fire again.
+ **/
+static irqreturn_t onic_q_aggr_handler(int irq, void *dev_id)
+{
+	struct onic_q_vector *vec = dev_id;
+	struct onic_private *priv = vec->priv;
+	struct onic_ring *ring = &vec->intr_ring;
+	struct qdma_intr_ring_entry entry;
+	u16 qid;
+
+	while (1) {
+		qdma_unpack_intr_ring_entry(&entry, ring->desc +
+			QDMA_INTR_RING_ENTRY_SIZE * ring->next_to_clean);
+		if (entry.color != ring->color)
+			break;
+
+		qid = entry.qid - priv->hw.qbase;
+		if (qid < ONIC_MAX_QUEUES) {
+			struct onic_rx_queue *rxq = priv->rx_queue[qid];
+			struct onic_tx_queue *txq = priv->tx_queue[qid];
+
+			if (entry.type == QDMA_C2H && rxq)
+				napi_schedule_irqoff(&rxq->napi);
+			else if (entry.type == QDMA_H2C && txq)
+				napi_schedule_irqoff(&txq->napi);
+		}
+
+		if (++ring->next_to_clean == ring->count) {
+			ring->next_to_clean = 0;
+			ring->color = !ring->color;
+		}
+	}
+
+	onic_set_intr_ring_tail(priv->hw.qdma, vec->vid, ring->next_to_clean);
 	return IRQ_HANDLED;
 }
 
@@ -72,17 +118,73 @@ static irqreturn_t onic_error_thread_fn(int irq, void *dev_id)
 }
 
 /**
- * onic_init_q_vector - clear a queue vector
+ * onic_clear_intr_ring - clear the interrupt aggregation ring of a vector
+ * @priv: pointer to driver private data
+ * @vec: pointer to queue vector
+ **/
+static void onic_clear_intr_ring(struct onic_private *priv,
+				 struct onic_q_vector *vec)
+{
+	struct onic_ring *ring = &vec->intr_ring;
+
+	if (!ring->desc)
+		return;
+	onic_qdma_clear_intr_ring(priv->hw.qdma, vec->vid);
+	dma_free_coherent(&priv->pdev->dev, ONIC_INTR_RING_SIZE, ring->desc,
+			  ring->dma_addr);
+	ring->desc = NULL;
+}
+
+/**
+ * onic_init_intr_ring - initialize the interrupt aggregation ring of a vector
+ * @priv: pointer to driver private data
+ * @vec: pointer to queue vector
+ *
+ * Return 0 on success, negative on failure
+ **/
+static int onic_init_intr_ring(struct onic_private *priv,
+			       struct onic_q_vector *vec)
+{
+	struct onic_ring *ring = &vec->intr_ring;
+	int rv;
+
+	ring->desc = dma_alloc_coherent(&priv->pdev->dev, ONIC_INTR_RING_SIZE,
+					&ring->dma_addr, GFP_KERNEL);
+	if (!ring->desc)
+		return -ENOMEM;
+	memset(ring->desc, 0, ONIC_INTR_RING_SIZE);
+	ring->count = ONIC_INTR_RING_SIZE / QDMA_INTR_RING_ENTRY_SIZE;
+	ring->next_to_clean = 0;
+	ring->color = 1;
+
+	rv = onic_qdma_init_intr_ring(priv->hw.qdma, vec->vid, ring->dma_addr);
+	if (rv < 0) {
+		dma_free_coherent(&priv->pdev->dev, ONIC_INTR_RING_SIZE,
+				  ring->desc, ring->dma_addr);
+		ring->desc = NULL;
+	}
+	return rv;
+}
+
+/**
+ * onic_clear_q_vector - clear a queue vector
  * @priv: pointer to driver private data
  * @vid: vector ID
  **/
 static void onic_clear_q_vector(struct onic_private *priv, u16 vid)
 {
 	struct onic_q_vector *vec = priv->q_vector[vid];
+	int irq = pci_irq_vector(priv->pdev, vid);
 
 	if (!vec)
 		return;
-	free_irq(pci_irq_vector(priv->pdev, vid), vec);
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 17, 0)
+	irq_update_affinity_hint(irq, NULL);
+#else
+	irq_set_affinity_hint(irq, NULL);
+#endif
+	free_irq(irq, vec);
+	onic_clear_intr_ring(priv, vec);
 	kfree(vec);
 }
 
@@ -100,29 +202,58 @@ static int onic_init_q_vector(struct onic_private *priv, u16 vid)
 	struct pci_dev *pdev = priv->pdev;
 	struct onic_q_vector *vec;
 	char* name = (char*)vmalloc(sizeof(char)*ONIC_MAX_IRQ_NAME);
+	irq_handler_t handler = onic_q_handler;
+	int irq = pci_irq_vector(pdev, vid);
+	int cpu, node;
 	int rv;
 
-	vec = kzalloc(sizeof(struct onic_q_vector), GFP_KERNEL);
+	/* spread vectors over the CPUs of the device node first, then over the
+	 * remaining nodes, and keep the vector and its queues on the node of
+	 * the CPU servicing them
+	 */
+	cpu = cpumask_local_spread(vid, dev_to_node(&pdev->dev));
+	node = cpu_to_node(cpu);
+
+	vec = kzalloc_node(sizeof(struct onic_q_vector), GFP_KERNEL, node);
 	if (!vec)
 		return -ENOMEM;
 	vec->priv = priv;
 	vec->vid = vid;
+	cpumask_set_cpu(cpu, &vec->affinity_mask);
+	vec->numa_node = node;
 
 	snprintf(name, ONIC_MAX_IRQ_NAME, "%s-%d", priv->netdev->name, vid);
-	rv = request_irq(pci_irq_vector(pdev, vid), onic_q_handler,
-			 0, name, vec);
+	if (test_bit(ONIC_FLAG_INTR_AGGR, priv->flags)) {
+		rv = onic_init_intr_ring(priv, vec);
+		if (rv < 0) {
+			dev_err(&pdev->dev,
+				"Failed to setup interrupt ring of vector %d",
+				vid);
+			kfree(vec);
+			return rv;
+		}
+		handler = onic_q_aggr_handler;
+	}
+
+	rv = request_irq(irq, handler, 0, name, vec);
 	if (rv < 0) {
 		dev_err(&pdev->dev, "Failed to setup queue vector %s", name);
+		onic_clear_intr_ring(priv, vec);
+		kfree(vec);
 		return rv;
 	}
 
-	/* setup affinity mask and node */
-	/* cpu = vid % num_online_cpus(); */
-	/* cpumask_set_cpu(cpu, &vec->affinity_mask); */
-	/* vec->numa_node = node; */
-
-	dev_info(&pdev->dev, "Setup IRQ vector %d with name %s",
-		 pci_irq_vector(pdev, vid), name);
+	/* the interrupt is moved to the CPU the vector and its queues were
+	 * placed for, and the hint lets irqbalance keep it there
+	 */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 17, 0)
+	irq_set_affinity_and_hint(irq, &vec->affinity_mask);
+#else
+	irq_set_affinity_hint(irq, &vec->affinity_mask);
+#endif
+
+	dev_info(&pdev->dev, "Setup IRQ vector %d with name %s on CPU %d",
+		 irq, name, cpu);
 	priv->q_vector[vid] = vec;
 
 	return 0;
@@ -172,15 +303,34 @@ static int onic_acquire_msix_vectors(struct onic_private *priv)
  *
  * The number of active queues equals to either the number of queue vectors, or
  * the real number of queues in the associated net device, whichever is smaller.
+ * With fewer queue vectors than online CPUs, queue interrupts are aggregated
+ * and there is one queue per CPU instead, provided the interrupt rings of the
+ * function can be addressed.
  **/
 static void onic_set_num_queues(struct onic_private *priv)
 {
 	struct net_device *dev = priv->netdev;
+	u16 num_queues = priv->num_q_vectors;
+	u16 num_cpus = min_t(u16, num_online_cpus(), ONIC_MAX_QUEUES);
+
+	if (priv->num_q_vectors < num_cpus) {
+		if (onic_intr_aggr_supported(priv, priv->num_q_vectors)) {
+			dev_info(&priv->pdev->dev,
+				 "Aggregating interrupts of %d queues on %d vectors",
+				 num_cpus, priv->num_q_vectors);
+			set_bit(ONIC_FLAG_INTR_AGGR, priv->flags);
+			num_queues = num_cpus;
+		} else {
+			dev_info(&priv->pdev->dev,
+				 "No interrupt ring for function, using %d queues on direct interrupts",
+				 priv->num_q_vectors);
+		}
+	}
 
 	priv->num_tx_queues =
-		min_t(u16, priv->num_q_vectors, dev->real_num_tx_queues);
+		min_t(u16, num_queues, dev->real_num_tx_queues);
 	priv->num_rx_queues =
-		min_t(u16, priv->num_q_vectors, dev->real_num_rx_queues);
+		min_t(u16, num_queues, dev->real_num_rx_queues);
 }
 
 int onic_init_capacity(struct onic_private *priv)
@@ -199,6 +349,7 @@ void onic_clear_capacity(struct onic_private *priv)
 	priv->num_tx_queues = 0;
 	priv->num_rx_queues = 0;
 	priv->num_q_vectors = 0;
+	clear_bit(ONIC_FLAG_INTR_AGGR, priv->flags);
 	pci_free_irq_vectors(priv->pdev);
 }
 
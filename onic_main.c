@@ -53,6 +53,10 @@ MODULE_VERSION(DRV_VER);
 static int RS_FEC_ENABLED=1;
 module_param(RS_FEC_ENABLED, int, 0644);
 
+/* size in bytes of C2H completion entries: 8, 16, 32 or 64 */
+static int RX_CMPL_SIZE=8;
+module_param(RX_CMPL_SIZE, int, 0644);
+
 #ifdef CMS_SUPPORT
 extern int xocl_init_xmc(void);
 extern void xocl_fini_xmc(void);
@@ -142,6 +146,9 @@ static const struct net_device_ops onic_netdev_ops = {
 	.ndo_xdp_xmit = onic_xdp_xmit,
 #endif
 #endif
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 10, 0)
+	.ndo_xsk_wakeup = onic_xsk_wakeup,
+#endif
 };
 
 extern void onic_set_ethtool_ops(struct net_device *netdev);
@@ -204,9 +211,17 @@ static int onic_probe(struct pci_dev *pdev, const struct pci_device_id *ent)
 
 	SET_NETDEV_DEV(netdev, &pdev->dev);
 	netdev->netdev_ops = &onic_netdev_ops;
+	netdev->max_mtu = ONIC_MAX_MTU;
 	onic_set_ethtool_ops(netdev);
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 3, 0)
+	netdev->xdp_metadata_ops = &onic_xdp_metadata_ops;
+#endif
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(6,3,0)
-	xdp_set_features_flag(netdev, NETDEV_XDP_ACT_BASIC | NETDEV_XDP_ACT_REDIRECT);
+	/* ndo_xdp_xmit does not depend on an XDP program being attached */
+	xdp_set_features_flag(netdev, NETDEV_XDP_ACT_BASIC | NETDEV_XDP_ACT_REDIRECT |
+				      NETDEV_XDP_ACT_RX_SG | NETDEV_XDP_ACT_NDO_XMIT |
+				      NETDEV_XDP_ACT_NDO_XMIT_SG |
+				      NETDEV_XDP_ACT_XSK_ZEROCOPY);
 #endif
 	snprintf(dev_name, IFNAMSIZ, "onic%ds%df%d",
 		 pdev->bus->number,
@@ -224,6 +239,63 @@ static int onic_probe(struct pci_dev *pdev, const struct pci_device_id *ent)
 	memset(priv, 0, sizeof(struct onic_private));
 	priv->RS_FEC = RS_FEC_ENABLED;
 
+	switch (RX_CMPL_SIZE) {
+	case 64:
+		priv->cmpl_desc_sz = QDMA_CMPL_DESC_SZ_64B;
+		break;
+	case 32:
+		priv->cmpl_desc_sz = QDMA_CMPL_DESC_SZ_32B;
+		break;
+	case 16:
+		priv->cmpl_desc_sz = QDMA_CMPL_DESC_SZ_16B;
+		break;
+	default:
+		dev_warn(&pdev->dev, "invalid RX_CMPL_SIZE %d, using 8",
+			 RX_CMPL_SIZE);
+		fallthrough;
+	case 8:
+		priv->cmpl_desc_sz = QDMA_CMPL_DESC_SZ_8B;
+		break;
+	}
+
+	priv->rx_copybreak = ONIC_RX_COPYBREAK;
+	priv->tx_copybreak = ONIC_TX_COPYBREAK;
+	priv->tx_rngcnt_idx = ONIC_DEFAULT_TX_RNGCNT_IDX;
+	priv->rx_rngcnt_idx = ONIC_DEFAULT_RX_RNGCNT_IDX;
+	priv->cmpl_rngcnt_idx = ONIC_DEFAULT_CMPL_RNGCNT_IDX;
+	priv->rx_coal.timer_idx = 0;
+	priv->rx_coal.counter_idx = 0;
+	priv->rx_coal.trig_mode = QDMA_CMPL_TRIG_USER_TIMER_COUNT;
+
+	/* nonlinear skbs are sent as one H2C descriptor per buffer.  The stack
+	 * only keeps SG with a checksum feature, but the shell has no checksum
+	 * offload: CHECKSUM_PARTIAL skbs are checksummed in software by
+	 * skb_checksum_help in onic_xmit_frame.
+	 */
+	netdev->hw_features |= NETIF_F_SG | NETIF_F_HW_CSUM;
+	netdev->features |= NETIF_F_SG | NETIF_F_HW_CSUM;
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 9, 0)
+	/* TSO and UDP GSO are segmented by the driver, which also computes the
+	 * checksums of every segment on the CPU
+	 */
+	netdev->hw_features |= NETIF_F_TSO | NETIF_F_TSO6 | NETIF_F_GSO_UDP_L4;
+	netdev->features |= NETIF_F_TSO | NETIF_F_TSO6 | NETIF_F_GSO_UDP_L4;
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 19, 0)
+	netif_set_tso_max_segs(netdev, ONIC_TSO_MAX_SEGS);
+#else
+	netdev->gso_max_segs = ONIC_TSO_MAX_SEGS;
+#endif
+#endif
+
+	/* wide completion entries carry RSS hash and checksum status */
+	if (priv->cmpl_desc_sz != QDMA_CMPL_DESC_SZ_8B) {
+		netdev->hw_features |= NETIF_F_RXHASH | NETIF_F_RXCSUM;
+		netdev->features |= NETIF_F_RXHASH | NETIF_F_RXCSUM;
+	}
+
+	/* queues are set up by onic_open_netdev */
+	set_bit(ONIC_DOWN, priv->state);
+
 	if (PCI_FUNC(pdev->devfn) == 0) {
 		dev_info(&pdev->dev, "device is a master PF");
 		set_bit(ONIC_FLAG_MASTER_PF, priv->flags);
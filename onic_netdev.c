@@ -20,6 +20,7 @@
 #include <linux/pci.h>
 #include <linux/etherdevice.h>
 #include <linux/netdevice.h>
+#include <linux/if_vlan.h>
 #include <linux/bpf.h>
 #include <linux/filter.h>
 #include <linux/bpf_trace.h>
@@ -30,13 +31,47 @@
 #else 
 #include <net/page_pool.h>
 #endif
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 10, 0)
+#include <net/xdp_sock_drv.h>
+#endif
+
+#include <net/tso.h>
+#include <net/checksum.h>
+#include <net/ip6_checksum.h>
+#include <net/ip.h>
+#include <linux/ip.h>
+#include <linux/ipv6.h>
 
 #include "onic_netdev.h"
 #include "onic_hardware.h"
 #include "qdma_access/qdma_register.h"
 #include "onic.h"
 
-#define ONIC_RX_DESC_STEP 256
+/* C2H buffers start after the XDP headroom.  The first buffer of a packet is
+ * turned into an skb head in place, so the tail of the page is kept free for
+ * skb_shared_info.
+ */
+#define ONIC_RX_BUF_MAX_LEN						\
+	(PAGE_SIZE - XDP_PACKET_HEADROOM -				\
+	 SKB_DATA_ALIGN(sizeof(struct skb_shared_info)))
+#define ONIC_RX_FRAME_LEN(mtu)		((mtu) + ETH_HLEN + VLAN_HLEN)
+
+/* Without XDP, RX buffers are half-page fragments holding packet data only.
+ * Headers are copied into a small skb and the rest is attached as frags.
+ */
+#define ONIC_RX_FRAG_SIZE		2048
+#define ONIC_RX_HDR_SIZE		256
+
+/**
+ * struct onic_xdp_buff - XDP buffer with the completion entry of its packet
+ *
+ * The XDP metadata kfuncs get the xdp_buff as context and read the RSS hash
+ * from the completion entry.
+ **/
+struct onic_xdp_buff {
+	struct xdp_buff xdp;
+	const struct qdma_c2h_cmpl *cmpl;
+};
 
 inline static u16 onic_ring_get_real_count(struct onic_ring *ring)
 {
@@ -62,26 +97,57 @@ inline static void onic_ring_increment_tail(struct onic_ring *ring)
 	ring->next_to_clean = (ring->next_to_clean + 1) % real_count;
 }
 
-static void onic_tx_clean(struct onic_tx_queue *q)
+/* Number of descriptors that can be handed to hardware without overrunning
+ * the ones it still owns.  One entry is always kept empty so that a full ring
+ * can be told apart from an empty one.
+ */
+inline static u16 onic_ring_unused(struct onic_ring *ring)
+{
+	u16 real_count = onic_ring_get_real_count(ring);
+	return (ring->next_to_clean + real_count - ring->next_to_use - 1) %
+		real_count;
+}
+
+/* Number of entries between next_to_clean and the hardware producer index */
+inline static u16 onic_ring_pending(struct onic_ring *ring, u16 pidx)
+{
+	u16 real_count = onic_ring_get_real_count(ring);
+	return (pidx + real_count - ring->next_to_clean) % real_count;
+}
+
+/**
+ * onic_tx_unmap - unmap the data of a descriptor holding part of an skb
+ * @dev: DMA device
+ * @buf: TX buffer of the descriptor
+ *
+ * TSO headers live in the coherent header buffer of the queue and are not
+ * mapped.
+ **/
+static void onic_tx_unmap(struct device *dev, struct onic_tx_buffer *buf)
+{
+	if (buf->type == ONIC_TX_SKB)
+		dma_unmap_single(dev, buf->dma_addr, buf->len, DMA_TO_DEVICE);
+	else if (buf->type == ONIC_TX_SKB_FRAG)
+		dma_unmap_page(dev, buf->dma_addr, buf->len, DMA_TO_DEVICE);
+}
+
+/**
+ * onic_tx_clean_to - release TX descriptors up to a ring index
+ * @q: pointer to TX queue
+ * @cidx: index of the first descriptor to keep
+ **/
+static void onic_tx_clean_to(struct onic_tx_queue *q, u16 cidx)
 {
 	struct onic_private *priv = netdev_priv(q->netdev);
 	struct onic_ring *ring = &q->ring;
-	struct qdma_wb_stat wb;
+	u32 xsk_frames = 0;
+	unsigned int pkts = 0, bytes = 0;
 	int work, i;
 
-	// this is a locking mechanism to guarantee that only one thread is cleaning the ring
-	// bitmask functions are atomic!
-	if (test_and_set_bit(0, q->state))
-		return;
-
-	qdma_unpack_wb_stat(&wb, ring->wb);
-
-	if (wb.cidx == ring->next_to_clean) {
-		clear_bit(0, q->state);
+	if (cidx == ring->next_to_clean)
 		return;
-	}
 
-	work = wb.cidx - ring->next_to_clean;
+	work = cidx - ring->next_to_clean;
 	if (work < 0)
 		work += onic_ring_get_real_count(ring);
 
@@ -89,21 +155,35 @@ static void onic_tx_clean(struct onic_tx_queue *q)
 		struct onic_tx_buffer *buf = &q->buffer[ring->next_to_clean];
 
 
-		if (buf->type == ONIC_TX_SKB) {
+		if (buf->type & (ONIC_TX_SKB | ONIC_TX_SKB_FRAG | ONIC_TX_TSO_HDR |
+				 ONIC_TX_BOUNCE)) {
 			// The packet originated from the kernel network stack
-			dma_unmap_single(&priv->pdev->dev, buf->dma_addr, buf->len, DMA_TO_DEVICE);
-			dev_kfree_skb_any(buf->skb);
+			// Nonlinear and TSO skbs are freed with their last descriptor
+			// Copied packets were freed at transmission
+			onic_tx_unmap(&priv->pdev->dev, buf);
+			pkts += buf->gso_segs;
+			bytes += buf->bytecount;
+			if (buf->skb)
+				dev_kfree_skb_any(buf->skb);
 			buf->skb = NULL;
+			buf->gso_segs = 0;
+			buf->bytecount = 0;
 		}  else if (buf->type == ONIC_TX_XDPF) {
 			// The packet originated from a XDP_TX -> It comes from a page pool, no need to dma unmap
-			xdp_return_frame(buf->xdpf);
+			// Multi-buffer frames are returned with their last descriptor
+			if (buf->xdpf)
+				xdp_return_frame(buf->xdpf);
 			buf->xdpf = NULL;
 		} else if (buf->type == ONIC_TX_XDPF_XMIT) {
 			// The packet originated from the XDP program of another driver. 
 			// It was mapped to a DMA address and needs to be unmapped
 			dma_unmap_single(&priv->pdev->dev, buf->dma_addr, buf->len, DMA_TO_DEVICE);
-			xdp_return_frame(buf->xdpf);
+			if (buf->xdpf)
+				xdp_return_frame(buf->xdpf);
 			buf->xdpf = NULL;
+		} else if (buf->type == ONIC_TX_XSK) {
+			// AF_XDP zero-copy frames are completed to the pool in bulk
+			xsk_frames++;
 		}
 		 else {
 			netdev_err(priv->netdev, "unknown buffer type %d\n", buf->type);
@@ -112,156 +192,485 @@ static void onic_tx_clean(struct onic_tx_queue *q)
 		onic_ring_increment_tail(ring);
 	}
 
-	clear_bit(0, q->state);
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 10, 0)
+	if (xsk_frames)
+		xsk_tx_completed(q->xsk_pool, xsk_frames);
+#endif
+	if (!q->xdp)
+		netdev_tx_completed_queue(netdev_get_tx_queue(q->netdev, q->qid),
+					  pkts, bytes);
 }
 
-static bool onic_rx_high_watermark(struct onic_rx_queue *q)
+static void onic_tx_clean(struct onic_tx_queue *q)
 {
-	struct onic_ring *ring = &q->desc_ring;
-	int unused;
+	struct qdma_wb_stat wb;
+
+	qdma_unpack_wb_stat(&wb, q->ring.wb);
+	onic_tx_clean_to(q, wb.cidx);
+}
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 10, 0)
+/**
+ * onic_xsk_xmit - move AF_XDP TX descriptors to the TX ring
+ * @q: pointer to TX queue bound to an XSK pool
+ * @budget: maximum number of descriptors to move
+ *
+ * The TX ring is shared with the stack and XDP, hence the TX queue lock.
+ * Return true if the XSK TX ring was drained within the budget.
+ **/
+static bool onic_xsk_xmit(struct onic_tx_queue *q, int budget)
+{
+	struct onic_private *priv = netdev_priv(q->netdev);
+	struct netdev_queue *nq = netdev_get_tx_queue(q->netdev, q->qid);
+	struct onic_ring *ring = &q->ring;
+	struct rtnl_link_stats64 *pcpu_stats_pointer;
+	struct qdma_h2c_st_desc desc;
+	struct xdp_desc xdesc;
+	u64 tx_bytes = 0;
+	int sent = 0;
+
+	__netif_tx_lock(nq, smp_processor_id());
+
+	while (sent < budget && onic_ring_unused(ring) &&
+	       xsk_tx_peek_desc(q->xsk_pool, &xdesc)) {
+		struct onic_tx_buffer *buf = &q->buffer[ring->next_to_use];
+		dma_addr_t dma_addr;
+
+		dma_addr = xsk_buff_raw_get_dma(q->xsk_pool, xdesc.addr);
+		xsk_buff_raw_dma_sync_for_device(q->xsk_pool, dma_addr,
+						 xdesc.len);
+
+		desc.len = xdesc.len;
+		desc.src_addr = dma_addr;
+		desc.metadata = xdesc.len;
+		qdma_pack_h2c_st_desc(ring->desc +
+				      QDMA_H2C_ST_DESC_SIZE * ring->next_to_use,
+				      &desc);
+
+		buf->type = ONIC_TX_XSK;
+		buf->xdpf = NULL;
+		buf->dma_addr = dma_addr;
+		buf->len = xdesc.len;
+
+		onic_ring_increment_head(ring);
+		tx_bytes += xdesc.len;
+		sent++;
+	}
+
+	if (sent) {
+		xsk_tx_release(q->xsk_pool);
+		wmb();
+		onic_set_tx_head(priv->hw.qdma, q->qid, ring->next_to_use, 0);
+	}
+
+	__netif_tx_unlock(nq);
 
-	unused = ring->next_to_use - ring->next_to_clean;
-	if (ring->next_to_use < ring->next_to_clean)
-		unused += onic_ring_get_real_count(ring);
+	pcpu_stats_pointer = this_cpu_ptr(priv->netdev_stats);
+	pcpu_stats_pointer->tx_packets += sent;
+	pcpu_stats_pointer->tx_bytes += tx_bytes;
 
-	return (unused < (ONIC_RX_DESC_STEP / 2));
+	return sent < budget;
 }
+#endif
 
-static void onic_rx_refill(struct onic_rx_queue *q)
+/**
+ * onic_tx_poll - NAPI poll for TX completions
+ * @napi: TX queue NAPI
+ * @budget: NAPI budget, zero when called from netpoll
+ *
+ * Clean the TX ring this NAPI belongs to and wake the queue if it was stopped.
+ * The ring is only ever cleaned here, so no lock is needed against other
+ * cleaners.  A queue bound to an AF_XDP pool also sends from the XSK TX ring
+ * here.  On completion the H2C interrupt is re-armed and the writeback is
+ * checked once more for completions that arrived before the interrupt was
+ * armed.
+ **/
+static int onic_tx_poll(struct napi_struct *napi, int budget)
 {
+	struct onic_tx_queue *q =
+		container_of(napi, struct onic_tx_queue, napi);
 	struct onic_private *priv = netdev_priv(q->netdev);
-	struct onic_ring *ring = &q->desc_ring;
+	struct netdev_queue *nq = netdev_get_tx_queue(q->netdev, q->qid);
+	struct onic_ring *ring = &q->ring;
+	struct qdma_wb_stat wb;
+	bool xsk_done = true;
+
+	onic_tx_clean(q);
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 10, 0)
+	if (q->xsk_pool && budget) {
+		xsk_done = onic_xsk_xmit(q, budget);
+		if (xsk_uses_need_wakeup(q->xsk_pool))
+			xsk_set_tx_need_wakeup(q->xsk_pool);
+	}
+#endif
+
+	/* the cleaned descriptors must be visible before the queue state is
+	 * read, pairs with the barrier in onic_maybe_stop_tx.  A queue stopped
+	 * by onic_stop_netdev stays stopped.
+	 */
+	smp_mb();
+	if (netif_tx_queue_stopped(nq) &&
+	    onic_ring_unused(ring) >= ONIC_TX_WAKE_THRESH &&
+	    !test_bit(ONIC_DOWN, priv->state))
+		netif_tx_wake_queue(nq);
+
+	if (!budget)
+		return 0;
+	if (!xsk_done)
+		return budget;
+	if (!napi_complete_done(napi, 0))
+		return 0;
 
-	ring->next_to_use += ONIC_RX_DESC_STEP;
-	ring->next_to_use %= onic_ring_get_real_count(ring);
+	/* re-arming writes the doorbell, which must not race with the xmit
+	 * paths moving it forward
+	 */
+	__netif_tx_lock(nq, smp_processor_id());
+	onic_set_tx_head(priv->hw.qdma, q->qid, ring->next_to_use, 1);
+	__netif_tx_unlock(nq);
 
-	onic_set_rx_head(priv->hw.qdma, q->qid, ring->next_to_use);
+	qdma_unpack_wb_stat(&wb, ring->wb);
+	if (wb.cidx != ring->next_to_clean)
+		napi_schedule(napi);
 
+	return 0;
 }
 
-static void onic_rx_page_refill(struct onic_rx_queue *q)
+/**
+ * onic_rx_alloc_buffers - refill free RX descriptors
+ * @q: pointer to RX queue
+ *
+ * Attach a page to every descriptor consumed since the last refill and
+ * advance the RX ring head pointer once for the whole batch.  Descriptors
+ * whose page was not handed off keep it.  Queues bound to an AF_XDP pool take
+ * their buffers from the XSK fill ring instead.  Return true if the page pool
+ * or fill ring ran dry before the ring was refilled.
+ **/
+static bool onic_rx_alloc_buffers(struct onic_rx_queue *q)
 {
-	struct onic_ring *desc_ring = &q->desc_ring;
-	struct qdma_c2h_st_desc desc;
-	struct page *pg;
-	u8 *desc_ptr = desc_ring->desc + QDMA_C2H_ST_DESC_SIZE * desc_ring->next_to_clean;
+	struct onic_private *priv = netdev_priv(q->netdev);
+	struct onic_ring *ring = &q->desc_ring;
+	u16 real_count = onic_ring_get_real_count(ring);
+	u16 count = onic_ring_unused(ring);
+	u16 ntu = ring->next_to_use;
+	bool failed = false;
+
+	while (count--) {
+		struct onic_rx_buffer *buf = &q->buffer[ntu];
+		u8 *desc_ptr = ring->desc + QDMA_C2H_ST_DESC_SIZE * ntu;
+		struct qdma_c2h_st_desc desc;
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 10, 0)
+		if (q->xsk_pool) {
+			if (!buf->xdp) {
+				buf->xdp = xsk_buff_alloc(q->xsk_pool);
+				if (unlikely(!buf->xdp)) {
+					failed = true;
+					break;
+				}
+			}
+
+			desc.dst_addr = xsk_buff_xdp_get_dma(buf->xdp);
+			qdma_pack_c2h_st_desc(desc_ptr, &desc);
+
+			ntu = (ntu + 1) % real_count;
+			continue;
+		}
+#endif
+
+		if (!buf->pg) {
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 15, 0)
+			if (q->page_frag)
+				buf->pg = page_pool_dev_alloc_frag(q->page_pool,
+								   &buf->offset,
+								   ONIC_RX_FRAG_SIZE);
+			else
+#endif
+			{
+				buf->pg = page_pool_dev_alloc_pages(q->page_pool);
+				buf->offset = XDP_PACKET_HEADROOM;
+			}
+			if (unlikely(!buf->pg)) {
+				failed = true;
+				break;
+			}
+		}
 
-	pg = page_pool_dev_alloc_pages(q->page_pool);
+		desc.dst_addr = page_pool_get_dma_addr(buf->pg) + buf->offset;
+		qdma_pack_c2h_st_desc(desc_ptr, &desc);
 
-	q->buffer[desc_ring->next_to_clean].pg = pg;
-	q->buffer[desc_ring->next_to_clean].offset = XDP_PACKET_HEADROOM;
+		ntu = (ntu + 1) % real_count;
+	}
 
+	if (ntu != ring->next_to_use) {
+		ring->next_to_use = ntu;
+		/* descriptors must be visible before the head pointer update */
+		wmb();
+		onic_set_rx_head(priv->hw.qdma, q->qid, ntu);
+	}
 
-	desc.dst_addr = page_pool_get_dma_addr(pg) + XDP_PACKET_HEADROOM;
-	qdma_pack_c2h_st_desc(desc_ptr, &desc);
+	return failed;
 }
 
+/**
+ * onic_xdp_tx_queue_mapping - pick the TX queue for XDP frames of this CPU
+ * @priv: pointer to driver private data
+ *
+ * The dedicated XDP TX queues are used if the function has any, the stack TX
+ * queues otherwise.
+ **/
 static struct onic_tx_queue *onic_xdp_tx_queue_mapping(struct onic_private *priv)
 {
 	unsigned int r_idx = smp_processor_id();
 
+	if (test_bit(ONIC_XDP_TX_QUEUES, priv->state))
+		return priv->xdp_tx_queue[r_idx % priv->num_xdp_queues];
+
 	if (r_idx >= priv->num_tx_queues)
 		r_idx = r_idx % priv->num_tx_queues;
 
 	return priv->tx_queue[r_idx];
 }
 
+/**
+ * onic_xdp_tx_lock - serialize XDP transmission on a TX queue
+ * @q: pointer to TX queue
+ *
+ * Stack TX queues are shared with onic_xmit_frame and use the netdev queue
+ * lock.  A dedicated XDP queue is only locked when CPUs share it, and gets its
+ * completed descriptors cleaned here.
+ **/
+static void onic_xdp_tx_lock(struct onic_tx_queue *q)
+{
+	if (!q->xdp) {
+		__netif_tx_lock(netdev_get_tx_queue(q->netdev, q->qid),
+				smp_processor_id());
+		return;
+	}
+
+	if (q->xdp_locked)
+		spin_lock(&q->xdp_lock);
+	onic_tx_clean(q);
+}
+
+static void onic_xdp_tx_unlock(struct onic_tx_queue *q)
+{
+	if (!q->xdp)
+		__netif_tx_unlock(netdev_get_tx_queue(q->netdev, q->qid));
+	else if (q->xdp_locked)
+		spin_unlock(&q->xdp_lock);
+}
+
 static int onic_xmit_xdp_ring(struct onic_private *priv,struct  onic_tx_queue  *tx_queue, struct xdp_frame *xdpf, bool dma_map)
  {
-	u8 *desc_ptr;
-	dma_addr_t dma_addr;
-	struct onic_ring *ring;
+	struct device *dev = &priv->pdev->dev;
+	struct onic_ring *ring = &tx_queue->ring;
+	u16 real_count = onic_ring_get_real_count(ring);
+	struct skb_shared_info *sinfo = NULL;
 	struct qdma_h2c_st_desc desc;
-	bool debug = 1;
+	struct onic_tx_buffer *buf;
+	bool debug = 0;
 	struct rtnl_link_stats64 *pcpu_stats_pointer;
 	enum onic_tx_buf_type type;
+	u32 pkt_len = xdpf->len;
+	u16 ntu = ring->next_to_use;
+	int nr_frags = 0;
+	int i;
 
-	ring = &tx_queue->ring;
-	
-	onic_tx_clean(tx_queue);
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 18, 0)
+	if (unlikely(xdp_frame_has_frags(xdpf))) {
+		sinfo = xdp_get_shared_info_from_frame(xdpf);
+		nr_frags = sinfo->nr_frags;
+		pkt_len += sinfo->xdp_frags_size;
+	}
+#endif
 
-	if (onic_ring_full(ring)) {
+	/* one descriptor for the head and one for each frag */
+	if (onic_ring_unused(ring) < nr_frags + 1) {
 		if (debug)
 			netdev_info(priv->netdev, "ring is full");
-		return NETDEV_TX_BUSY;
+		return ONIC_XDP_CONSUMED;
 	}
 
-	if (dma_map) {
-		/* ndo_xdp_dmit */
-		dma_addr = dma_map_single(&priv->pdev->dev, xdpf->data,xdpf->len, DMA_TO_DEVICE);
-		type = ONIC_TX_XDPF_XMIT;
-		if (unlikely(dma_mapping_error(&priv->pdev->dev, dma_addr)))
-			return ONIC_XDP_CONSUMED;
-	} else {
-		/* ONIC_XDP_TX */
-		struct page *page = virt_to_page(xdpf->data);
-		//TODO  i don't get why adding the size of the xdp_frame struct to the dma_addr. mvneta does this 
-		dma_addr = page_pool_get_dma_addr(page) + sizeof(*xdpf) + xdpf->headroom;
-		dma_sync_single_for_device(&priv->pdev->dev, dma_addr,
-					   xdpf->len, DMA_BIDIRECTIONAL);
-		type = ONIC_TX_XDPF;
-		
-	}
+	/* ndo_xdp_xmit frames are mapped here, XDP_TX frames come from our
+	 * page pool and are already mapped
+	 */
+	type = dma_map ? ONIC_TX_XDPF_XMIT : ONIC_TX_XDPF;
 
-	
+	for (i = 0; i <= nr_frags; i++) {
+		dma_addr_t dma_addr;
+		void *data;
+		u32 len;
 
-	desc_ptr = ring->desc + QDMA_H2C_ST_DESC_SIZE * ring->next_to_use;
-	desc.len = xdpf->len;
-	desc.src_addr = dma_addr;
-	desc.metadata = xdpf->len;
-	qdma_pack_h2c_st_desc(desc_ptr, &desc);
+		if (i == 0) {
+			data = xdpf->data;
+			len = xdpf->len;
+		} else {
+			data = skb_frag_address(&sinfo->frags[i - 1]);
+			len = skb_frag_size(&sinfo->frags[i - 1]);
+		}
 
-	tx_queue->buffer[ring->next_to_use].xdpf = xdpf;
-	tx_queue->buffer[ring->next_to_use].type = type;
-	tx_queue->buffer[ring->next_to_use].dma_addr = dma_addr;
-	tx_queue->buffer[ring->next_to_use].len = xdpf->len;
-	
+		if (dma_map) {
+			dma_addr = dma_map_single(dev, data, len, DMA_TO_DEVICE);
+			if (unlikely(dma_mapping_error(dev, dma_addr)))
+				goto unmap;
+		} else {
+			dma_addr = page_pool_get_dma_addr(virt_to_page(data)) +
+				   offset_in_page(data);
+			dma_sync_single_for_device(dev, dma_addr, len,
+						   DMA_BIDIRECTIONAL);
+		}
+
+		/* every descriptor of a packet carries the packet length */
+		desc.len = len;
+		desc.src_addr = dma_addr;
+		desc.metadata = pkt_len;
+		qdma_pack_h2c_st_desc(ring->desc + QDMA_H2C_ST_DESC_SIZE * ntu,
+				      &desc);
+
+		/* the frame is released with its last descriptor */
+		buf = &tx_queue->buffer[ntu];
+		buf->xdpf = (i == nr_frags) ? xdpf : NULL;
+		buf->type = type;
+		buf->dma_addr = dma_addr;
+		buf->len = len;
+
+		ntu = (ntu + 1) % real_count;
+	}
+
+	ring->next_to_use = ntu;
 
 	pcpu_stats_pointer = this_cpu_ptr(priv->netdev_stats);
 	pcpu_stats_pointer->tx_packets++;
-	pcpu_stats_pointer->tx_bytes += xdpf->len;
-	onic_ring_increment_head(ring);
+	pcpu_stats_pointer->tx_bytes += pkt_len;
 
 	return ONIC_XDP_TX;
+
+unmap:
+	while (i--) {
+		ntu = (ntu + real_count - 1) % real_count;
+		buf = &tx_queue->buffer[ntu];
+		dma_unmap_single(dev, buf->dma_addr, buf->len, DMA_TO_DEVICE);
+		buf->xdpf = NULL;
+	}
+	return ONIC_XDP_CONSUMED;
+}
+
+/**
+ * onic_xdp_tx_flush - transmit the XDP_TX frames held by an RX queue
+ * @q: pointer to RX queue
+ *
+ * All held frames are written into the H2C ring of the XDP TX queue of this
+ * CPU under one lock acquisition and followed by a single doorbell.  Frames
+ * that do not fit in the ring are dropped.
+ **/
+static void onic_xdp_tx_flush(struct onic_rx_queue *q)
+{
+	struct onic_private *priv = netdev_priv(q->netdev);
+	struct onic_tx_queue *tx_queue = onic_xdp_tx_queue_mapping(priv);
+	/* frames copied out of AF_XDP buffers are not page pool mapped */
+	bool dma_map = !!q->xsk_pool;
+	int i, sent = 0;
+
+	if (!q->xdp_tx_bulk_count)
+		return;
+
+	onic_xdp_tx_lock(tx_queue);
+	for (i = 0; i < q->xdp_tx_bulk_count; i++) {
+		struct xdp_frame *xdpf = q->xdp_tx_bulk[i];
+
+		if (onic_xmit_xdp_ring(priv, tx_queue, xdpf, dma_map) !=
+		    ONIC_XDP_TX) {
+			xdp_return_frame_rx_napi(xdpf);
+			q->xdp_rx_stats.xdp_tx_err++;
+			continue;
+		}
+		q->xdp_rx_stats.xdp_tx++;
+		sent++;
+	}
+
+	if (sent) {
+		wmb();
+		onic_set_tx_head(priv->hw.qdma, tx_queue->qid,
+				 tx_queue->ring.next_to_use, 0);
+	}
+	onic_xdp_tx_unlock(tx_queue);
+
+	q->xdp_tx_bulk_count = 0;
+}
+
+/**
+ * onic_xdp_tx_queue_frame - hold an XDP_TX frame until the end of the poll
+ * @q: pointer to RX queue
+ * @xdpf: XDP frame
+ **/
+static void onic_xdp_tx_queue_frame(struct onic_rx_queue *q,
+				    struct xdp_frame *xdpf)
+{
+	if (q->xdp_tx_bulk_count == ONIC_XDP_TX_BULK_SIZE)
+		onic_xdp_tx_flush(q);
+
+	q->xdp_tx_bulk[q->xdp_tx_bulk_count++] = xdpf;
 }
 
 static int onic_xdp_xmit_back(struct onic_rx_queue *q, struct xdp_buff *xdp_buff) {
 	struct onic_private *priv = netdev_priv(q->netdev);
 	struct xdp_frame *xdpf = xdp_convert_buff_to_frame(xdp_buff);
-	struct onic_tx_queue *tx_queue;
-	struct netdev_queue *nq;
-	u32 ret = 0, cpu = smp_processor_id();
 
 	if (unlikely(!xdpf)){
 		q->xdp_rx_stats.xdp_tx_err++;
 		return ONIC_XDP_CONSUMED;
 	}
 
-	tx_queue = q->xdp_prog ? priv->tx_queue[q->qid] : NULL;
-	if (unlikely(!tx_queue)){
+	if (unlikely(!q->xdp_prog || !onic_xdp_tx_queue_mapping(priv))){
 		q->xdp_rx_stats.xdp_tx_err++;
-		return -ENXIO;
+		return ONIC_XDP_CONSUMED;
 	}
 
-	nq = netdev_get_tx_queue(tx_queue->netdev, tx_queue->qid);
+	onic_xdp_tx_queue_frame(q, xdpf);
 
-	__netif_tx_lock(nq, cpu);
-	ret = onic_xmit_xdp_ring(priv, tx_queue, xdpf,false);
-	q->xdp_rx_stats.xdp_tx++;
+	return ONIC_XDP_TX;
+}
 
-	wmb();
-	onic_set_tx_head(priv->hw.qdma, tx_queue->qid, tx_queue->ring.next_to_use);
+/**
+ * onic_xdp_has_frags - check if an XDP program handles multi-buffer packets
+ * @prog: XDP program
+ **/
+static bool onic_xdp_has_frags(struct bpf_prog *prog)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 18, 0)
+	return prog->aux->xdp_has_frags;
+#else
+	return false;
+#endif
+}
 
-	__netif_tx_unlock(nq);
+/**
+ * onic_rx_recycle_xdp - return the pages of an XDP buffer to the page pool
+ * @q: pointer to RX queue
+ * @xdp: XDP buffer, including its frags if any
+ **/
+static void onic_rx_recycle_xdp(struct onic_rx_queue *q, struct xdp_buff *xdp)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 18, 0)
+	if (unlikely(xdp_buff_has_frags(xdp))) {
+		struct skb_shared_info *sinfo =
+			xdp_get_shared_info_from_buff(xdp);
+		int i;
 
-	return ret;
+		for (i = 0; i < sinfo->nr_frags; i++)
+			page_pool_recycle_direct(q->page_pool,
+						 skb_frag_page(&sinfo->frags[i]));
+	}
+#endif
+	page_pool_recycle_direct(q->page_pool,
+				 virt_to_page(xdp->data_hard_start));
 }
 
 static void *onic_run_xdp(struct onic_rx_queue *rx_queue, struct xdp_buff *xdp_buff, struct onic_private *priv) {
 	int err, result = ONIC_XDP_PASS;
 	struct bpf_prog *xdp_prog;
 	u32 act;
-	struct page *page = virt_to_page(xdp_buff->data_hard_start);
 	
 	xdp_prog = rx_queue->xdp_prog;
 	if (!xdp_prog){
@@ -330,7 +739,8 @@ out_failure:
     case XDP_DROP:
 			result = ONIC_XDP_CONSUMED;
 			rx_queue->xdp_rx_stats.xdp_drop++;
-			page_pool_recycle_direct(rx_queue->page_pool, page);
+			this_cpu_ptr(priv->netdev_stats)->rx_dropped++;
+			onic_rx_recycle_xdp(rx_queue, xdp_buff);
 			break;
   }
 
@@ -338,274 +748,869 @@ out:
 	return ERR_PTR(-result);
 }
 
-static int onic_rx_poll(struct napi_struct *napi, int budget)
+/**
+ * onic_rx_recycle_buffers - drop the buffers of a packet
+ * @q: pointer to RX queue
+ * @nr_bufs: number of descriptors holding the packet
+ *
+ * Return the pages at next_to_clean of the descriptor ring to the page pool
+ * and move past them.
+ **/
+static void onic_rx_recycle_buffers(struct onic_rx_queue *q, int nr_bufs)
 {
-	struct onic_rx_queue *q =
-		container_of(napi, struct onic_rx_queue, napi);
-	struct onic_private *priv = netdev_priv(q->netdev);
-	u16 qid = q->qid;
-	struct onic_ring *desc_ring = &q->desc_ring;
-	struct onic_ring *cmpl_ring = &q->cmpl_ring;
-	struct qdma_c2h_cmpl cmpl;
-	struct qdma_c2h_cmpl_stat cmpl_stat;
-	u8 *cmpl_ptr;
-	u8 *cmpl_stat_ptr;
-	u32 color_stat;
-	int work = 0;
-	int i, rv;
-	bool napi_cmpl_rval = 0;
-	bool flipped = 0;
-	bool debug = 0;
-	void *res;
+	struct onic_ring *ring = &q->desc_ring;
 
-	struct xdp_buff xdp;
-	unsigned int xdp_xmit = 0;
-	struct rtnl_link_stats64 *pcpu_stats_pointer;
-	pcpu_stats_pointer = this_cpu_ptr(priv->netdev_stats);
+	while (nr_bufs--) {
+		struct onic_rx_buffer *buf = &q->buffer[ring->next_to_clean];
 
-	for (i = 0; i < priv->num_tx_queues; i++)
-		onic_tx_clean(priv->tx_queue[i]);
+		page_pool_recycle_direct(q->page_pool, buf->pg);
+		buf->pg = NULL;
+		onic_ring_increment_tail(ring);
+	}
+}
 
-	cmpl_ptr =
-		cmpl_ring->desc + QDMA_C2H_CMPL_SIZE * cmpl_ring->next_to_clean;
-	cmpl_stat_ptr =
-		cmpl_ring->desc + QDMA_C2H_CMPL_SIZE * (cmpl_ring->count - 1);
+/**
+ * onic_rx_offloads - apply RSS hash and checksum status to an skb
+ * @dev: pointer to network device
+ * @skb: received packet
+ * @cmpl: completion entry describing the packet
+ *
+ * Both are only reported in wide completion entries.  Otherwise the stack
+ * computes them in software.
+ **/
+static void onic_rx_offloads(struct net_device *dev, struct sk_buff *skb,
+			     const struct qdma_c2h_cmpl *cmpl)
+{
+	skb->ip_summed = CHECKSUM_NONE;
+	if ((dev->features & NETIF_F_RXCSUM) &&
+	    cmpl->l3_csum_ok && cmpl->l4_csum_ok)
+		skb->ip_summed = CHECKSUM_UNNECESSARY;
+
+	if ((dev->features & NETIF_F_RXHASH) &&
+	    cmpl->rss_type != QDMA_C2H_CMPL_RSS_TYPE_NONE)
+		skb_set_hash(skb, cmpl->rss_hash,
+			     (cmpl->rss_type == QDMA_C2H_CMPL_RSS_TYPE_L4) ?
+			     PKT_HASH_TYPE_L4 : PKT_HASH_TYPE_L3);
+}
 
-	qdma_unpack_c2h_cmpl(&cmpl, cmpl_ptr);
-	qdma_unpack_c2h_cmpl_stat(&cmpl_stat, cmpl_stat_ptr);
+/**
+ * onic_rx_deliver - pass a received skb up the stack
+ * @q: pointer to RX queue
+ * @skb: received packet
+ * @cmpl: completion entry describing the packet
+ **/
+static void onic_rx_deliver(struct onic_rx_queue *q, struct sk_buff *skb,
+			    const struct qdma_c2h_cmpl *cmpl)
+{
+	skb->protocol = eth_type_trans(skb, q->netdev);
+	onic_rx_offloads(q->netdev, skb, cmpl);
+	skb_record_rx_queue(skb, q->qid);
+	napi_gro_receive(&q->napi, skb);
+}
 
-	color_stat = cmpl_stat.color;
-	if (debug)
-		netdev_info(
-			q->netdev,
-			"\n rx_poll:  cmpl_stat_pidx %u, color_cmpl_stat %u, cmpl_ring next_to_clean %u, cmpl_stat_cidx %u, intr_state %u, cmpl_ring->count %u",
-			cmpl_stat.pidx, color_stat, cmpl_ring->next_to_clean,
-			cmpl_stat.cidx, cmpl_stat.intr_state, cmpl_ring->count);
+/**
+ * onic_rx_copy_skb - copy a small packet into a new skb
+ * @q: pointer to RX queue
+ * @buf: RX buffer holding the packet
+ * @len: packet length
+ *
+ * The page stays attached to its descriptor and is handed back to hardware
+ * by the next refill, without a round trip through the page pool.  Return
+ * the new skb, or NULL if allocation failed.
+ **/
+static struct sk_buff *onic_rx_copy_skb(struct onic_rx_queue *q,
+					struct onic_rx_buffer *buf, int len)
+{
+	struct onic_private *priv = netdev_priv(q->netdev);
+	enum dma_data_direction dma_dir = page_pool_get_dma_dir(q->page_pool);
+	dma_addr_t dma_addr = page_pool_get_dma_addr(buf->pg) + buf->offset;
+	struct sk_buff *skb;
 
-	if (debug)
-		netdev_info(
-			q->netdev,
-			"c2h_cmpl pkt_id %u, pkt_len %u, error %u, color %u cmpl_ring->color:%u",
-			cmpl.pkt_id, cmpl.pkt_len, cmpl.err, cmpl.color,
-			cmpl_ring->color);
-
-	/* Color of completion entries and completion ring are initialized to 0
-	 * and 1 respectively.  When an entry is filled, it has a color bit of
-	 * 1, thus making it the same as the completion ring color.  A different
-	 * color indicates that we are done with the current batch.  When the
-	 * ring index wraps around, the color flips in both software and
-	 * hardware.  Therefore, it becomes that completion entries are filled
-	 * with a color 0, and completion ring has a color 0 as well.
-	 */
-	if (cmpl.color != cmpl_ring->color) {
-		if (debug)
-			netdev_info(
-				q->netdev,
-				"color mismatch1: cmpl.color %u, cmpl_ring->color %u  cmpl_stat_color %u",
-				cmpl.color, cmpl_ring->color, color_stat);
-	}
+	skb = napi_alloc_skb(&q->napi, len);
+	if (unlikely(!skb))
+		return NULL;
 
-	if (cmpl.err == 1) {
-		if (debug)
-			netdev_info(q->netdev, "completion error detected in cmpl entry!");
-		// todo: need to handle the error ...
-		onic_qdma_clear_error_interrupt(priv->hw.qdma);
+	dma_sync_single_for_cpu(&priv->pdev->dev, dma_addr, len, dma_dir);
+	skb_put_data(skb, page_address(buf->pg) + buf->offset, len);
+	dma_sync_single_for_device(&priv->pdev->dev, dma_addr, len, dma_dir);
+
+	return skb;
+}
+
+/**
+ * onic_rx_frag_skb - build an skb from half-page RX buffers
+ * @q: pointer to RX queue
+ * @len: packet length
+ * @nr_bufs: number of descriptors holding the packet
+ *
+ * Half-page buffers have no room for headroom or skb_shared_info.  Packet
+ * headers are copied into a small skb and the payload is attached as page
+ * frags.  Return the skb, or NULL if allocation failed.
+ **/
+static struct sk_buff *onic_rx_frag_skb(struct onic_rx_queue *q, int len,
+					int nr_bufs)
+{
+	struct onic_private *priv = netdev_priv(q->netdev);
+	enum dma_data_direction dma_dir = page_pool_get_dma_dir(q->page_pool);
+	struct onic_ring *ring = &q->desc_ring;
+	struct sk_buff *skb;
+	int i;
+
+	skb = napi_alloc_skb(&q->napi, ONIC_RX_HDR_SIZE);
+	if (unlikely(!skb)) {
+		onic_rx_recycle_buffers(q, nr_bufs);
+		return NULL;
 	}
 
-	// main processing loop for rx_poll
-	while ((cmpl_ring->next_to_clean != cmpl_stat.pidx)) {
-		struct onic_rx_buffer *buf =
-			&q->buffer[desc_ring->next_to_clean];
-		struct sk_buff *skb;
-		
-		int len = cmpl.pkt_len;
+	// mark the skb for page_pool recycling
+	skb_mark_for_recycle(skb);
 
-		xdp_init_buff(&xdp, PAGE_SIZE, &q->xdp_rxq);
+	for (i = 0; i < nr_bufs; i++) {
+		struct onic_rx_buffer *buf = &q->buffer[ring->next_to_clean];
+		void *va = page_address(buf->pg) + buf->offset;
+		int size = min_t(int, len, q->bufsz);
+		unsigned int headlen = 0;
 
+		len -= size;
 		dma_sync_single_for_cpu(&priv->pdev->dev,
 					page_pool_get_dma_addr(buf->pg) +
 						buf->offset,
-						len, DMA_FROM_DEVICE);
-   
-		xdp_prepare_buff(&xdp, page_address(buf->pg), buf->offset, len, false);
-		
-		res = onic_run_xdp(q, &xdp,priv);
-		if (IS_ERR(res)) {
-			unsigned int xdp_res = -PTR_ERR(res);
-
-			if (xdp_res & (ONIC_XDP_TX | ONIC_XDP_REDIR)) {
-				xdp_xmit |= xdp_res;
-			}
-
-			// Allocate skb only if we are continuing to process the packet
-			if (xdp_res & ONIC_XDP_PASS) {
-				
-				// allocate a new skb structure around the data 
-				skb = napi_build_skb(xdp.data_hard_start, PAGE_SIZE);
+					size, dma_dir);
 
-				if (!skb) {
-					rv = -ENOMEM;
-					break;
-				}
-				
-				// mark the skb for page_pool recycling
-				skb_mark_for_recycle(skb);
-				// reserve space in the skb for the data for the xdp headroom
-				skb_reserve(skb, xdp.data - xdp.data_hard_start);
-				// set the data pointer
-				skb_put(skb, xdp.data_end - xdp.data);
-
-				skb->protocol = eth_type_trans(skb, q->netdev);
-				skb->ip_summed = CHECKSUM_NONE;
-				skb_record_rx_queue(skb, qid);
-				rv = napi_gro_receive(napi, skb);
-				if (rv < 0) {
-					netdev_err(q->netdev, "napi_gro_receive, err = %d", rv);
-					break;
-				}
-			}
+		if (i == 0) {
+			headlen = eth_get_headlen(q->netdev, va,
+						  min_t(int, size,
+							ONIC_RX_HDR_SIZE));
+			skb_put_data(skb, va, headlen);
 		}
 
+		if (size > headlen)
+			skb_add_rx_frag(skb, skb_shinfo(skb)->nr_frags, buf->pg,
+					buf->offset + headlen, size - headlen,
+					ONIC_RX_FRAG_SIZE);
+		else
+			page_pool_recycle_direct(q->page_pool, buf->pg);
 
-		// here the page where packet data was written has either been recycled or marked for recycling
-		onic_rx_page_refill(q);
+		buf->pg = NULL;
+		onic_ring_increment_tail(ring);
+	}
 
-		pcpu_stats_pointer->rx_packets++;
-		pcpu_stats_pointer->rx_bytes += len;
+	return skb;
+}
 
-		onic_ring_increment_tail(desc_ring);
+/**
+ * onic_rx_packet - process one received packet
+ * @q: pointer to RX queue
+ * @xdp: XDP buffer initialized for this queue
+ * @cmpl: completion entry describing the packet
+ *
+ * Run XDP on the packet at next_to_clean of the descriptor ring and pass it
+ * up the stack if needed.  A packet longer than the C2H buffer size spans
+ * several descriptors; the first one becomes the head of the XDP buffer and
+ * skb, and the others are attached as frags.  Pages are detached from their
+ * descriptors, which are refilled later by onic_rx_alloc_buffers.  Small
+ * packets are copied instead and leave their page in place.  Return the
+ * ONIC_XDP_* result, ONIC_XDP_CONSUMED if the packet was not delivered.
+ **/
+static unsigned int onic_rx_packet(struct onic_rx_queue *q,
+				   struct xdp_buff *xdp,
+				   const struct qdma_c2h_cmpl *cmpl)
+{
+	struct onic_private *priv = netdev_priv(q->netdev);
+	enum dma_data_direction dma_dir = page_pool_get_dma_dir(q->page_pool);
+	struct onic_ring *ring = &q->desc_ring;
+	struct onic_rx_buffer *buf = &q->buffer[ring->next_to_clean];
+	struct rtnl_link_stats64 *pcpu_stats_pointer;
+	int len = cmpl->pkt_len;
+	int nr_bufs = (len > q->bufsz) ? DIV_ROUND_UP(len, q->bufsz) : 1;
+	int size = min_t(int, len, q->bufsz);
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 18, 0)
+	struct skb_shared_info *sinfo;
+	u8 nr_frags = 0;
+#endif
+	unsigned int xdp_res;
+	struct sk_buff *skb;
+	void *res;
+	int i;
 
-		if (debug)
-			netdev_info(
-				q->netdev,
-				"desc_ring %u next_to_use:%u next_to_clean:%u",
-				onic_ring_get_real_count(desc_ring),
-				desc_ring->next_to_use,
-				desc_ring->next_to_clean);
-		if (onic_ring_full(desc_ring)) {
-			netdev_dbg(q->netdev, "desc_ring full");
-		}
+	if (unlikely(cmpl->err)) {
+		// todo: need to handle the error ...
+		onic_qdma_clear_error_interrupt(priv->hw.qdma);
+		onic_rx_recycle_buffers(q, nr_bufs);
+		pcpu_stats_pointer = this_cpu_ptr(priv->netdev_stats);
+		pcpu_stats_pointer->rx_errors++;
+		return ONIC_XDP_CONSUMED;
+	}
 
-		if (onic_rx_high_watermark(q)) {
-			netdev_dbg(q->netdev, "High watermark: h = %d, t = %d",
-				   desc_ring->next_to_use,
-				   desc_ring->next_to_clean);
-			onic_rx_refill(q);
+	/* small packets are copied when there is no XDP program to run */
+	if (len <= READ_ONCE(priv->rx_copybreak) && nr_bufs == 1 &&
+	    !q->xdp_prog) {
+		skb = onic_rx_copy_skb(q, buf, len);
+		onic_ring_increment_tail(ring);
+		if (unlikely(!skb)) {
+			pcpu_stats_pointer = this_cpu_ptr(priv->netdev_stats);
+			pcpu_stats_pointer->rx_dropped++;
+			return ONIC_XDP_CONSUMED;
 		}
 
-		onic_ring_increment_tail(cmpl_ring);
+		onic_rx_deliver(q, skb, cmpl);
+		return ONIC_XDP_PASS;
+	}
 
-		if (debug)
-			netdev_info(
-				q->netdev,
-				"cmpl_ring %u next_to_use:%u next_to_clean:%u, flipped:%s",
-				onic_ring_get_real_count(cmpl_ring),
-				cmpl_ring->next_to_use,
-				cmpl_ring->next_to_clean,
-				flipped ? "true" : "false");
-		if (onic_ring_full(cmpl_ring)) {
-			netdev_dbg(q->netdev, "cmpl_ring full");
-		}
-		if (cmpl.color != cmpl_ring->color) {
-			if (debug)
-				netdev_info(
-					q->netdev,
-					"part 1. cmpl_ring->next_to_clean=%u color *** old fliping *** color[%u]",
-					cmpl_ring->next_to_clean,
-					cmpl_ring->color);
-			cmpl_ring->color = (cmpl_ring->color == 0) ? 1 : 0;
-			flipped = 1;
-		}
-		cmpl_ptr = cmpl_ring->desc +
-			   (QDMA_C2H_CMPL_SIZE * cmpl_ring->next_to_clean);
-
-		if ((++work) >= budget) {
-			if (xdp_xmit & ONIC_XDP_REDIR)
-					xdp_do_flush();
-			if (debug)
-				netdev_info(q->netdev,
-					    "watchdog work %u, budget %u", work,
-					    budget);
-			napi_complete(napi);
-			napi_schedule(napi);
-			goto out_of_budget;
+	if (q->page_frag) {
+		skb = onic_rx_frag_skb(q, len, nr_bufs);
+		if (unlikely(!skb)) {
+			pcpu_stats_pointer = this_cpu_ptr(priv->netdev_stats);
+			pcpu_stats_pointer->rx_dropped++;
+			return ONIC_XDP_CONSUMED;
 		}
 
-		qdma_unpack_c2h_cmpl(&cmpl, cmpl_ptr);
+		onic_rx_deliver(q, skb, cmpl);
+		return ONIC_XDP_PASS;
+	}
 
-		if (debug)
-			netdev_info(
-				q->netdev,
-				"c2h_cmpl(b) pkt_id %u, pkt_len %u, error %u, color %u",
-				cmpl.pkt_id, cmpl.pkt_len, cmpl.err,
-				cmpl.color);
+	/* multi-buffer packets need an XDP program that handles frags */
+	if (unlikely(nr_bufs > 1 && q->xdp_prog &&
+		     !onic_xdp_has_frags(q->xdp_prog))) {
+		onic_rx_recycle_buffers(q, nr_bufs);
+		pcpu_stats_pointer = this_cpu_ptr(priv->netdev_stats);
+		pcpu_stats_pointer->rx_dropped++;
+		return ONIC_XDP_CONSUMED;
 	}
 
-	if (xdp_xmit & ONIC_XDP_REDIR)
-		xdp_do_flush();
+	dma_sync_single_for_cpu(&priv->pdev->dev,
+				page_pool_get_dma_addr(buf->pg) + buf->offset,
+				size, dma_dir);
+
+	xdp_prepare_buff(xdp, page_address(buf->pg), buf->offset, size, false);
+	buf->pg = NULL;
+	onic_ring_increment_tail(ring);
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 18, 0)
+	// attach the remaining descriptors of a jumbo frame as XDP frags
+	xdp_buff_clear_frags_flag(xdp);
+	sinfo = xdp_get_shared_info_from_buff(xdp);
+	if (unlikely(nr_bufs > 1)) {
+		sinfo->nr_frags = 0;
+		sinfo->xdp_frags_size = 0;
+		xdp_buff_set_frags_flag(xdp);
+	}
 
-	if (cmpl_ring->next_to_clean == cmpl_stat.pidx) {
-		if (debug)
-			netdev_info(
-				q->netdev,
-				"next_to_clean == cmpl_stat.pidx %u, napi_complete work %u, budget %u, rval %s",
-				cmpl_stat.pidx, work, budget,
-				napi_cmpl_rval ? "true" : "false");
-		napi_cmpl_rval = napi_complete_done(napi, work);
-		onic_set_completion_tail(priv->hw.qdma, qid,
-					 cmpl_ring->next_to_clean, 1);
-		if (debug)
-			netdev_info(q->netdev, "onic_set_completion_tail ");
-	} else if (cmpl_ring->next_to_clean == 0) {
-		if (debug)
-			netdev_info(
-				q->netdev,
-				"next_to_clean == 0, napi_complete work %u, budget %u, rval %s",
-				work, budget,
-				napi_cmpl_rval ? "true" : "false");
-		if (debug)
-			netdev_info(q->netdev,
-				    "napi_complete work %u, budget %u, rval %s",
-				    work, budget,
-				    napi_cmpl_rval ? "true" : "false");
-		napi_cmpl_rval = napi_complete_done(napi, work);
-		onic_set_completion_tail(priv->hw.qdma, qid,
-					 cmpl_ring->next_to_clean, 1);
-		if (debug)
-			netdev_info(q->netdev, "onic_set_completion_tail ");
+	for (i = 1; i < nr_bufs; i++) {
+		skb_frag_t *frag = &sinfo->frags[sinfo->nr_frags++];
+
+		buf = &q->buffer[ring->next_to_clean];
+		len -= size;
+		size = min_t(int, len, q->bufsz);
+
+		dma_sync_single_for_cpu(&priv->pdev->dev,
+					page_pool_get_dma_addr(buf->pg) +
+						buf->offset,
+					size, dma_dir);
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 5, 0)
+		skb_frag_fill_page_desc(frag, buf->pg, buf->offset, size);
+#else
+		__skb_frag_set_page(frag, buf->pg);
+		skb_frag_off_set(frag, buf->offset);
+		skb_frag_size_set(frag, size);
+#endif
+		sinfo->xdp_frags_size += size;
+		if (page_is_pfmemalloc(buf->pg))
+			xdp_buff_set_frag_pfmemalloc(xdp);
+
+		buf->pg = NULL;
+		onic_ring_increment_tail(ring);
 	}
+#endif
+
+	res = onic_run_xdp(q, xdp, priv);
+	xdp_res = -PTR_ERR(res);
+
+	// the pages have been recycled, transmitted or redirected
+	if (!(xdp_res & ONIC_XDP_PASS))
+		return xdp_res;
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 18, 0)
+	// napi_build_skb clears nr_frags in the shared info
+	if (unlikely(xdp_buff_has_frags(xdp)))
+		nr_frags = sinfo->nr_frags;
+#endif
+
+	// allocate a new skb structure around the data
+	skb = napi_build_skb(xdp->data_hard_start, PAGE_SIZE);
+	if (unlikely(!skb)) {
+		onic_rx_recycle_xdp(q, xdp);
+#if LINUX_VERSION_CODE < KERNEL_VERSION(5, 18, 0)
+		onic_rx_recycle_buffers(q, nr_bufs - 1);
+#endif
+		pcpu_stats_pointer = this_cpu_ptr(priv->netdev_stats);
+		pcpu_stats_pointer->rx_dropped++;
+		return ONIC_XDP_CONSUMED;
+	}
+
+	// mark the skb for page_pool recycling
+	skb_mark_for_recycle(skb);
+	// reserve space in the skb for the data for the xdp headroom
+	skb_reserve(skb, xdp->data - xdp->data_hard_start);
+	// set the data pointer
+	skb_put(skb, xdp->data_end - xdp->data);
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 18, 0)
+	if (unlikely(nr_frags))
+		xdp_update_skb_shared_info(skb, nr_frags,
+					   sinfo->xdp_frags_size,
+					   nr_frags * PAGE_SIZE,
+					   xdp_buff_is_frag_pfmemalloc(xdp));
+#else
+	// chain the remaining descriptors of a jumbo frame as page frags
+	for (i = 1; i < nr_bufs; i++) {
+		buf = &q->buffer[ring->next_to_clean];
+		len -= size;
+		size = min_t(int, len, q->bufsz);
+
+		dma_sync_single_for_cpu(&priv->pdev->dev,
+					page_pool_get_dma_addr(buf->pg) +
+						buf->offset,
+					size, dma_dir);
+		skb_add_rx_frag(skb, i - 1, buf->pg, buf->offset, size,
+				PAGE_SIZE);
+		buf->pg = NULL;
+		onic_ring_increment_tail(ring);
+	}
+#endif
+
+	onic_rx_deliver(q, skb, cmpl);
+
+	return xdp_res;
+}
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 10, 0)
+/**
+ * onic_rx_free_xsk - drop the AF_XDP buffers of a packet
+ * @q: pointer to RX queue
+ * @nr_bufs: number of descriptors holding the packet
+ **/
+static void onic_rx_free_xsk(struct onic_rx_queue *q, int nr_bufs)
+{
+	struct onic_ring *ring = &q->desc_ring;
+
+	while (nr_bufs--) {
+		struct onic_rx_buffer *buf = &q->buffer[ring->next_to_clean];
+
+		xsk_buff_free(buf->xdp);
+		buf->xdp = NULL;
+		onic_ring_increment_tail(ring);
+	}
+}
+
+/**
+ * onic_rx_packet_zc - process one packet received into an AF_XDP buffer
+ * @q: pointer to RX queue bound to an XSK pool
+ * @cmpl: completion entry describing the packet
+ *
+ * Zero-copy queues always have an XDP program.  XDP_REDIRECT hands the buffer
+ * to the socket as is, while XDP_TX and XDP_PASS copy the packet out of the
+ * UMEM and free the buffer.  Packets spanning several descriptors are
+ * dropped.  Return the ONIC_XDP_* result, ONIC_XDP_CONSUMED if the packet
+ * was not delivered.
+ **/
+static unsigned int onic_rx_packet_zc(struct onic_rx_queue *q,
+				      const struct qdma_c2h_cmpl *cmpl)
+{
+	struct onic_private *priv = netdev_priv(q->netdev);
+	struct bpf_prog *xdp_prog = q->xdp_prog;
+	struct onic_ring *ring = &q->desc_ring;
+	struct rtnl_link_stats64 *pcpu_stats_pointer;
+	int len = cmpl->pkt_len;
+	int nr_bufs = (len > q->bufsz) ? DIV_ROUND_UP(len, q->bufsz) : 1;
+	struct xdp_frame *xdpf;
+	struct xdp_buff *xdp;
+	struct sk_buff *skb;
+	u32 act;
+
+	if (unlikely(cmpl->err || nr_bufs > 1)) {
+		if (cmpl->err)
+			onic_qdma_clear_error_interrupt(priv->hw.qdma);
+		onic_rx_free_xsk(q, nr_bufs);
+		pcpu_stats_pointer = this_cpu_ptr(priv->netdev_stats);
+		if (cmpl->err)
+			pcpu_stats_pointer->rx_errors++;
+		else
+			pcpu_stats_pointer->rx_dropped++;
+		return ONIC_XDP_CONSUMED;
+	}
+
+	xdp = q->buffer[ring->next_to_clean].xdp;
+	q->buffer[ring->next_to_clean].xdp = NULL;
+	onic_ring_increment_tail(ring);
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 8, 0)
+	/* the XSK buffer has room for our private fields after xdp_buff */
+	XSK_CHECK_PRIV_TYPE(struct onic_xdp_buff);
+	((struct onic_xdp_buff *)xdp)->cmpl = cmpl;
+#endif
+
+	xdp->data_end = xdp->data + len;
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 10, 0)
+	xsk_buff_dma_sync_for_cpu(xdp);
+#else
+	xsk_buff_dma_sync_for_cpu(xdp, q->xsk_pool);
+#endif
+
+	act = bpf_prog_run_xdp(xdp_prog, xdp);
+
+	switch (act) {
+	case XDP_REDIRECT:
+		if (xdp_do_redirect(q->netdev, xdp, xdp_prog))
+			goto out_failure;
+		q->xdp_rx_stats.xdp_redirect++;
+		return ONIC_XDP_REDIR;
+	case XDP_TX:
+		// the frame is copied to a regular page, freeing the XSK buffer
+		xdpf = xdp_convert_buff_to_frame(xdp);
+		if (unlikely(!xdpf))
+			goto out_failure;
+
+		onic_xdp_tx_queue_frame(q, xdpf);
+		return ONIC_XDP_TX;
+	case XDP_PASS:
+		q->xdp_rx_stats.xdp_pass++;
+		len = xdp->data_end - xdp->data;
+		skb = napi_alloc_skb(&q->napi, len);
+		if (likely(skb))
+			skb_put_data(skb, xdp->data, len);
+		xsk_buff_free(xdp);
+		if (unlikely(!skb)) {
+			pcpu_stats_pointer = this_cpu_ptr(priv->netdev_stats);
+			pcpu_stats_pointer->rx_dropped++;
+			return ONIC_XDP_CONSUMED;
+		}
+		onic_rx_deliver(q, skb, cmpl);
+		return ONIC_XDP_PASS;
+	default:
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5,17,0)
+		bpf_warn_invalid_xdp_action(q->netdev, xdp_prog, act);
+#else
+		bpf_warn_invalid_xdp_action(act);
+#endif
+		fallthrough;
+	case XDP_ABORTED:
+out_failure:
+		trace_xdp_exception(q->netdev, xdp_prog, act);
+		fallthrough;
+	case XDP_DROP:
+		q->xdp_rx_stats.xdp_drop++;
+		pcpu_stats_pointer = this_cpu_ptr(priv->netdev_stats);
+		pcpu_stats_pointer->rx_dropped++;
+		xsk_buff_free(xdp);
+		return ONIC_XDP_CONSUMED;
+	}
+}
+#endif
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 3, 0)
+/**
+ * onic_rx_dim_work - apply the moderation picked by net_dim
+ * @work: work item of the queue DIM context
+ *
+ * The DIM RX profile is mapped onto the closest timer and counter threshold
+ * pool entries, used from the next completion ring update on.
+ **/
+static void onic_rx_dim_work(struct work_struct *work)
+{
+	struct dim *dim = container_of(work, struct dim, work);
+	struct onic_rx_queue *q = container_of(dim, struct onic_rx_queue, dim);
+	struct onic_private *priv = netdev_priv(q->netdev);
+	struct onic_qdma_cmpl_coal coal = {};
+	struct dim_cq_moder moder;
+
+	if (READ_ONCE(priv->rx_dim_enabled)) {
+		moder = net_dim_get_rx_moderation(dim->mode, dim->profile_ix);
+		coal.timer_idx = onic_c2h_timer_idx(moder.usec);
+		coal.counter_idx = onic_c2h_thres_idx(moder.pkts);
+		coal.trig_mode = QDMA_CMPL_TRIG_USER_TIMER_COUNT;
+		WRITE_ONCE(q->coal, coal);
+	}
+
+	dim->state = DIM_START_MEASURE;
+}
+#endif
+
+static void onic_rx_dim_update(struct onic_rx_queue *q)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 3, 0)
+	struct dim_sample sample = {};
+
+	dim_update_sample(q->dim_stats.events, q->dim_stats.packets,
+			  q->dim_stats.bytes, &sample);
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 13, 0)
+	net_dim(&q->dim, &sample);
+#else
+	net_dim(&q->dim, sample);
+#endif
+#endif
+}
+
+static int onic_rx_poll(struct napi_struct *napi, int budget)
+{
+	struct onic_rx_queue *q =
+		container_of(napi, struct onic_rx_queue, napi);
+	struct onic_private *priv = netdev_priv(q->netdev);
+	u16 qid = q->qid;
+	struct onic_ring *cmpl_ring = &q->cmpl_ring;
+	struct qdma_c2h_cmpl_stat cmpl_stat;
+	struct onic_qdma_cmpl_coal coal;
+	struct rtnl_link_stats64 *pcpu_stats_pointer;
+	u64 rx_packets = 0, rx_bytes = 0;
+	unsigned int xdp_xmit = 0, res;
+	struct onic_xdp_buff xdp;
+	int work = 0, batch;
+	bool failed;
+	bool debug = 0;
+
+	/* The completion status writeback is read once per poll.  Everything
+	 * up to its producer index, capped by the budget, is processed as one
+	 * batch.  Completion entries are only valid after the status has been
+	 * read, hence the read barrier.
+	 */
+	qdma_unpack_c2h_cmpl_stat(&cmpl_stat, cmpl_ring->wb);
+	batch = min_t(int, onic_ring_pending(cmpl_ring, cmpl_stat.pidx),
+		      budget);
+	dma_rmb();
 
-out_of_budget:
-	if (debug)
-		netdev_info(q->netdev, "rx_poll is done");
 	if (debug)
-		netdev_info(
-			q->netdev,
-			"rx_poll returning work %u, rx_packets %lld, rx_bytes %lld",
-			work, pcpu_stats_pointer->rx_packets,
-			pcpu_stats_pointer->rx_bytes);
+		netdev_info(q->netdev,
+			    "rx_poll: cmpl_stat_pidx %u, cmpl_ring next_to_clean %u, batch %d, budget %d",
+			    cmpl_stat.pidx, cmpl_ring->next_to_clean, batch,
+			    budget);
+
+	xdp_init_buff(&xdp.xdp, PAGE_SIZE, &q->xdp_rxq);
+
+	while (work < batch) {
+		struct qdma_c2h_cmpl cmpl;
+		u8 *cmpl_ptr = cmpl_ring->desc +
+			QDMA_C2H_CMPL_ENTRY_SIZE(q->cmpl_desc_sz) *
+			cmpl_ring->next_to_clean;
+
+		qdma_unpack_c2h_cmpl(&cmpl, cmpl_ptr, q->cmpl_desc_sz);
+		xdp.cmpl = &cmpl;
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 10, 0)
+		if (q->xsk_pool)
+			res = onic_rx_packet_zc(q, &cmpl);
+		else
+#endif
+		res = onic_rx_packet(q, &xdp.xdp, &cmpl);
+		xdp_xmit |= res;
+		/* errors and drops are counted where they happen */
+		if (!(res & ONIC_XDP_CONSUMED)) {
+			rx_packets++;
+			rx_bytes += cmpl.pkt_len;
+		}
+
+		onic_ring_increment_tail(cmpl_ring);
+
+		/* Color of completion entries and completion ring are
+		 * initialized to 0 and 1 respectively.  When an entry is
+		 * filled, it has a color bit of 1, thus making it the same as
+		 * the completion ring color.  When the ring index wraps
+		 * around, the color flips in both software and hardware.
+		 */
+		if (cmpl_ring->next_to_clean == 0)
+			cmpl_ring->color = (cmpl_ring->color == 0) ? 1 : 0;
+
+		work++;
+	}
+
+	/* one TX doorbell for all XDP_TX frames of the poll */
+	if (xdp_xmit & ONIC_XDP_TX)
+		onic_xdp_tx_flush(q);
+
+	if (xdp_xmit & ONIC_XDP_REDIR)
+		xdp_do_flush();
+
+	/* refill the batch and ring the RX doorbell once */
+	failed = onic_rx_alloc_buffers(q);
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 10, 0)
+	/* with need_wakeup, user space kicks us after refilling the fill ring
+	 * instead of us polling for it
+	 */
+	if (q->xsk_pool && xsk_uses_need_wakeup(q->xsk_pool)) {
+		if (failed)
+			xsk_set_rx_need_wakeup(q->xsk_pool);
+		else
+			xsk_clear_rx_need_wakeup(q->xsk_pool);
+		failed = false;
+	}
+#endif
+	if (failed)
+		work = budget;
+
+	pcpu_stats_pointer = this_cpu_ptr(priv->netdev_stats);
+	pcpu_stats_pointer->rx_packets += rx_packets;
+	pcpu_stats_pointer->rx_bytes += rx_bytes;
+
+	q->dim_stats.packets += rx_packets;
+	q->dim_stats.bytes += rx_bytes;
+
+	/* DIM and ethtool update the moderation concurrently */
+	coal = READ_ONCE(q->coal);
+
+	if (work == budget) {
+		/* return the completion entries but stay in polling mode */
+		onic_set_completion_tail(priv->hw.qdma, qid,
+					 cmpl_ring->next_to_clean, &coal, 0);
+		return budget;
+	}
+
+	/* NAPI stays scheduled while busy polling or deferring hard
+	 * interrupts, in which case the interrupt is left disarmed
+	 */
+	if (!napi_complete_done(napi, work)) {
+		onic_set_completion_tail(priv->hw.qdma, qid,
+					 cmpl_ring->next_to_clean, &coal, 0);
+		return work;
+	}
+
+	/* one DIM event per interrupt */
+	q->dim_stats.events++;
+	if (READ_ONCE(priv->rx_dim_enabled))
+		onic_rx_dim_update(q);
+
+	onic_set_completion_tail(priv->hw.qdma, qid,
+				 cmpl_ring->next_to_clean, &coal, 1);
+
 	return work;
 }
 
-static void onic_clear_tx_queue(struct onic_private *priv, u16 qid)
+/**
+ * onic_dma_alloc_node - allocate coherent DMA memory on a NUMA node
+ * @dev: DMA device
+ * @size: size of the region
+ * @dma_addr: returned DMA address
+ * @node: NUMA node of the CPU using the region
+ *
+ * Coherent memory comes from the node of the device, which is pointed at
+ * @node for the duration of the allocation.  Callers hold the RTNL lock.
+ **/
+static void *onic_dma_alloc_node(struct device *dev, size_t size,
+				 dma_addr_t *dma_addr, int node)
+{
+	int dev_node = dev_to_node(dev);
+	void *vaddr;
+
+	set_dev_node(dev, node);
+	vaddr = dma_alloc_coherent(dev, size, dma_addr, GFP_KERNEL);
+	set_dev_node(dev, dev_node);
+
+	return vaddr;
+}
+
+/**
+ * onic_free_tx_slots - free the descriptor slots of a TX queue
+ * @priv: pointer to driver private data
+ * @q: pointer to TX queue
+ **/
+static void onic_free_tx_slots(struct onic_private *priv,
+			       struct onic_tx_queue *q)
+{
+	int i;
+
+	if (!q->slot_pages)
+		return;
+
+	for (i = 0; i < q->num_slot_pages; ++i) {
+		struct onic_tx_slot_page *page = &q->slot_pages[i];
+
+		if (page->va)
+			dma_free_coherent(&priv->pdev->dev, PAGE_SIZE,
+					  page->va, page->dma_addr);
+	}
+	kfree(q->slot_pages);
+	q->slot_pages = NULL;
+}
+
+/**
+ * onic_alloc_tx_slots - allocate the descriptor slots of a TX queue
+ * @priv: pointer to driver private data
+ * @q: pointer to TX queue
+ *
+ * Slots are allocated in pages rather than as one region, which large rings
+ * would not get on a fragmented system.  Return 0 on success, negative on
+ * failure
+ **/
+static int onic_alloc_tx_slots(struct onic_private *priv,
+			       struct onic_tx_queue *q)
+{
+	int node = q->vector->numa_node;
+	int i;
+
+	q->num_slot_pages = DIV_ROUND_UP(q->ring.count - 1,
+					 ONIC_TX_SLOTS_PER_PAGE);
+	q->slot_pages = kcalloc_node(q->num_slot_pages,
+				     sizeof(struct onic_tx_slot_page),
+				     GFP_KERNEL, node);
+	if (!q->slot_pages)
+		return -ENOMEM;
+
+	for (i = 0; i < q->num_slot_pages; ++i) {
+		struct onic_tx_slot_page *page = &q->slot_pages[i];
+
+		page->va = onic_dma_alloc_node(&priv->pdev->dev, PAGE_SIZE,
+					       &page->dma_addr, node);
+		if (!page->va) {
+			onic_free_tx_slots(priv, q);
+			return -ENOMEM;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * onic_tx_slot - get the slot of a TX descriptor
+ * @q: pointer to TX queue
+ * @ntu: descriptor index
+ * @dma_addr: returned DMA address of the slot
+ *
+ * Return the virtual address of the slot
+ **/
+static u8 *onic_tx_slot(struct onic_tx_queue *q, u16 ntu,
+			dma_addr_t *dma_addr)
+{
+	struct onic_tx_slot_page *page =
+		&q->slot_pages[ntu / ONIC_TX_SLOTS_PER_PAGE];
+	u32 offset = (ntu % ONIC_TX_SLOTS_PER_PAGE) * ONIC_TX_SLOT_SIZE;
+
+	*dma_addr = page->dma_addr + offset;
+	return page->va + offset;
+}
+
+/**
+ * onic_free_tx_ring - free the descriptor ring and buffers of a TX queue
+ * @priv: pointer to driver private data
+ * @q: pointer to TX queue
+ **/
+static void onic_free_tx_ring(struct onic_private *priv,
+			      struct onic_tx_queue *q)
+{
+	struct onic_ring *ring = &q->ring;
+	u32 size, real_count;
+
+	real_count = ring->count - 1;
+	size = QDMA_H2C_ST_DESC_SIZE * real_count + QDMA_WB_STAT_SIZE;
+	size = ALIGN(size, PAGE_SIZE);
+
+	if (ring->desc)
+		dma_free_coherent(&priv->pdev->dev, size, ring->desc,
+				  ring->dma_addr);
+	onic_free_tx_slots(priv, q);
+	kfree(q->buffer);
+	kfree(q);
+}
+
+/**
+ * onic_alloc_tx_ring - allocate a TX queue with its descriptor ring
+ * @priv: pointer to driver private data
+ * @qid: QDMA queue ID
+ * @node: NUMA node of the CPU servicing the queue
+ *
+ * Return the queue on success, ERR_PTR on failure
+ **/
+static struct onic_tx_queue *onic_alloc_tx_ring(struct onic_private *priv,
+						u16 qid, int node)
+{
+	struct net_device *dev = priv->netdev;
+	struct onic_tx_queue *q;
+	struct onic_ring *ring;
+	u32 size, real_count;
+
+	q = kzalloc_node(sizeof(struct onic_tx_queue), GFP_KERNEL, node);
+	if (!q)
+		return ERR_PTR(-ENOMEM);
+
+	q->netdev = dev;
+	q->qid = qid;
+
+	ring = &q->ring;
+	ring->count = onic_ring_count(priv->tx_rngcnt_idx);
+	real_count = ring->count - 1;
+
+	/* allocate DMA memory for TX descriptor ring */
+	size = QDMA_H2C_ST_DESC_SIZE * real_count + QDMA_WB_STAT_SIZE;
+	size = ALIGN(size, PAGE_SIZE);
+	ring->desc = onic_dma_alloc_node(&priv->pdev->dev, size,
+					 &ring->dma_addr, node);
+	if (!ring->desc)
+		goto free_tx_ring;
+	memset(ring->desc, 0, size);
+	ring->wb = ring->desc + QDMA_H2C_ST_DESC_SIZE * real_count;
+	ring->next_to_use = 0;
+	ring->next_to_clean = 0;
+	ring->color = 0;
+
+	netdev_info(dev, "TX queue %d, ring count %d, ring size %d, real_count %d", 
+		    qid, ring->count, size, real_count);
+
+	/* initialize TX buffers */
+	q->buffer = kcalloc_node(real_count, sizeof(struct onic_tx_buffer),
+				 GFP_KERNEL, node);
+	if (!q->buffer)
+		goto free_tx_ring;
+
+	return q;
+
+free_tx_ring:
+	onic_free_tx_ring(priv, q);
+	return ERR_PTR(-ENOMEM);
+}
+
+/**
+ * onic_disable_tx_queue - stop a TX queue from sending
+ * @priv: pointer to driver private data
+ * @qid: queue ID
+ *
+ * Once NAPI is disabled, the queue is no longer woken up and its ring may be
+ * freed with onic_free_tx_queue.
+ **/
+static void onic_disable_tx_queue(struct onic_private *priv, u16 qid)
+{
+	struct onic_tx_queue *q = priv->tx_queue[qid];
+
+	if (!q)
+		return;
+
+	onic_qdma_clear_tx_queue(priv->hw.qdma, qid);
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 8, 0)
+	netif_queue_set_napi(priv->netdev, qid, NETDEV_QUEUE_TYPE_TX, NULL);
+#endif
+	napi_disable(&q->napi);
+	netif_napi_del(&q->napi);
+}
+
+/**
+ * onic_free_tx_queue - free the ring and buffers of a disabled TX queue
+ * @priv: pointer to driver private data
+ * @qid: queue ID
+ **/
+static void onic_free_tx_queue(struct onic_private *priv, u16 qid)
 {
 	struct onic_tx_queue *q = priv->tx_queue[qid];
 	struct onic_ring *ring;
-	u32 size;
 	int real_count;
 	int i;
 
 	if (!q)
 		return;
 
-	onic_tx_clean(q);
-
-	onic_qdma_clear_tx_queue(priv->hw.qdma, qid);
+	/* the queue is disabled, so descriptors never completed are released
+	 * as well
+	 */
+	onic_tx_clean_to(q, q->ring.next_to_use);
+	netdev_tx_reset_queue(netdev_get_tx_queue(priv->netdev, qid));
 
 	ring = &q->ring;
 	real_count = ring->count - 1;
-	size = QDMA_H2C_ST_DESC_SIZE * real_count + QDMA_WB_STAT_SIZE;
-	size = ALIGN(size, PAGE_SIZE);
 
 	for (i = 0; i < real_count; ++i) {
 		if ((q->buffer[i].type & ONIC_TX_SKB ) && q->buffer[i].skb) {
@@ -615,23 +1620,71 @@ static void onic_clear_tx_queue(struct onic_private *priv, u16 qid)
 		}
 	}
 
-	if (ring->desc)
-		dma_free_coherent(&priv->pdev->dev, size, ring->desc,
-				  ring->dma_addr);
-	if (q->buffer) kfree(q->buffer);
-	kfree(q);
+	onic_free_tx_ring(priv, q);
 	priv->tx_queue[qid] = NULL;
 }
 
+static void onic_clear_tx_queue(struct onic_private *priv, u16 qid)
+{
+	onic_disable_tx_queue(priv, qid);
+	onic_free_tx_queue(priv, qid);
+}
+
+/**
+ * onic_set_xps_queue - steer transmits to a TX queue by CPU
+ * @priv: pointer to driver private data
+ * @q: pointer to TX queue
+ *
+ * A queue is used by the CPU servicing its vector.  With aggregated
+ * interrupts, vectors are fewer than CPUs and several queues share one, so
+ * CPU i uses queue i modulo the number of queues instead.
+ **/
+static void onic_set_xps_queue(struct onic_private *priv,
+			       struct onic_tx_queue *q)
+{
+	cpumask_var_t mask;
+	int cpu;
+
+	if (!test_bit(ONIC_FLAG_INTR_AGGR, priv->flags)) {
+		netif_set_xps_queue(priv->netdev, &q->vector->affinity_mask,
+				    q->qid);
+		return;
+	}
+
+	if (!zalloc_cpumask_var(&mask, GFP_KERNEL))
+		return;
+	for_each_possible_cpu(cpu) {
+		if (cpu % priv->num_tx_queues == q->qid)
+			cpumask_set_cpu(cpu, mask);
+	}
+	netif_set_xps_queue(priv->netdev, mask, q->qid);
+	free_cpumask_var(mask);
+}
+
+/**
+ * onic_xsk_pool - get the AF_XDP pool of a zero-copy queue pair
+ * @priv: pointer to driver private data
+ * @qid: queue ID
+ *
+ * Zero-copy is only used while an XDP program is attached.  Return NULL if
+ * the queue pair runs on the page pool.
+ **/
+static struct xsk_buff_pool *onic_xsk_pool(struct onic_private *priv, u16 qid)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 10, 0)
+	if (priv->xdp_prog && test_bit(qid, priv->af_xdp_zc_qps))
+		return xsk_get_pool_from_qid(priv->netdev, qid);
+#endif
+	return NULL;
+}
+
 static int onic_init_tx_queue(struct onic_private *priv, u16 qid)
 {
-	const u8 rngcnt_idx = 0;
 	struct net_device *dev = priv->netdev;
 	struct onic_tx_queue *q;
 	struct onic_ring *ring;
 	struct onic_qdma_h2c_param param;
 	u16 vid;
-	u32 size, real_count;
 	int rv;
 	bool debug = 0;
 
@@ -641,56 +1694,52 @@ static int onic_init_tx_queue(struct onic_private *priv, u16 qid)
 		onic_clear_tx_queue(priv, qid);
 	}
 
-	q = kzalloc(sizeof(struct onic_tx_queue), GFP_KERNEL);
-	if (!q)
-		return -ENOMEM;
-
 	/* evenly assign to TX queues available vectors */
 	vid = qid % priv->num_q_vectors;
 
-	q->netdev = dev;
-	q->vector = priv->q_vector[vid];
-	q->qid = qid;
+	q = onic_alloc_tx_ring(priv, qid, priv->q_vector[vid]->numa_node);
+	if (IS_ERR(q))
+		return PTR_ERR(q);
 
+	q->vector = priv->q_vector[vid];
+	q->xsk_pool = onic_xsk_pool(priv, qid);
 	ring = &q->ring;
-	ring->count = onic_ring_count(rngcnt_idx);
-	real_count = ring->count - 1;
+	priv->tx_queue[qid] = q;
 
-	/* allocate DMA memory for TX descriptor ring */
-	size = QDMA_H2C_ST_DESC_SIZE * real_count + QDMA_WB_STAT_SIZE;
-	size = ALIGN(size, PAGE_SIZE);
-	ring->desc = dma_alloc_coherent(&priv->pdev->dev, size, &ring->dma_addr,
-					GFP_KERNEL);
-	if (!ring->desc) {
-		rv = -ENOMEM;
-		goto clear_tx_queue;
+	/* the map is set once, so that a user XPS configuration outlives the
+	 * queue
+	 */
+	if (!test_and_set_bit(qid, priv->xps_init_done))
+		onic_set_xps_queue(priv, q);
+
+	/* TSO headers and small packets are written in place, mapped once */
+	rv = onic_alloc_tx_slots(priv, q);
+	if (rv < 0) {
+		priv->tx_queue[qid] = NULL;
+		onic_free_tx_ring(priv, q);
+		return rv;
 	}
-	memset(ring->desc, 0, size);
-	ring->wb = ring->desc + QDMA_H2C_ST_DESC_SIZE * real_count;
-	ring->next_to_use = 0;
-	ring->next_to_clean = 0;
-	ring->color = 0;
 
-	netdev_info(dev, "TX queue %d, ring count %d, ring size %d, real_count %d", 
-		    qid, ring->count, size, real_count);
-
-	/* initialize TX buffers */
-	q->buffer =
-		kcalloc(real_count, sizeof(struct onic_tx_buffer), GFP_KERNEL);
-	if (!q->buffer) {
-		rv = -ENOMEM;
-		goto clear_tx_queue;
-	}
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6,1,0)
+	netif_napi_add_tx(dev, &q->napi, onic_tx_poll);
+#else
+	netif_tx_napi_add(dev, &q->napi, onic_tx_poll, 64);
+#endif
+	napi_enable(&q->napi);
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 8, 0)
+	netif_queue_set_napi(dev, qid, NETDEV_QUEUE_TYPE_TX, &q->napi);
+#endif
 
 	/* initialize QDMA H2C queue */
-	param.rngcnt_idx = rngcnt_idx;
+	param.rngcnt_idx = priv->tx_rngcnt_idx;
 	param.dma_addr = ring->dma_addr;
 	param.vid = vid;
+	param.irq_en = 1;
+	param.intr_aggr = test_bit(ONIC_FLAG_INTR_AGGR, priv->flags);
 	rv = onic_qdma_init_tx_queue(priv->hw.qdma, qid, &param);
 	if (rv < 0)
 		goto clear_tx_queue;
 
-	priv->tx_queue[qid] = q;
 	return 0;
 
 clear_tx_queue:
@@ -698,20 +1747,101 @@ clear_tx_queue:
 	return rv;
 }
 
-static void onic_clear_rx_queue(struct onic_private *priv, u16 qid)
+static void onic_clear_xdp_tx_queue(struct onic_private *priv, u16 idx)
+{
+	struct onic_tx_queue *q = priv->xdp_tx_queue[idx];
+
+	if (!q)
+		return;
+
+	onic_qdma_clear_tx_queue(priv->hw.qdma, q->qid);
+	onic_tx_clean_to(q, q->ring.next_to_use);
+	onic_free_tx_ring(priv, q);
+	priv->xdp_tx_queue[idx] = NULL;
+}
+
+/**
+ * onic_init_xdp_tx_queue - initialize a dedicated XDP TX queue
+ * @priv: pointer to driver private data
+ * @idx: index of the XDP TX queue
+ *
+ * XDP TX queues have no NAPI context and raise no interrupt.  Completed
+ * descriptors are cleaned by the transmit path before new frames are added.
+ * With one queue per CPU, a queue is only ever used by its own CPU and no
+ * lock is taken.
+ **/
+static int onic_init_xdp_tx_queue(struct onic_private *priv, u16 idx)
+{
+	struct onic_qdma_h2c_param param;
+	struct onic_tx_queue *q;
+	int rv;
+
+	/* queue idx is used by CPU idx, and by the CPUs it wraps around to */
+	q = onic_alloc_tx_ring(priv, priv->xdp_qbase + idx,
+			       cpu_possible(idx) ? cpu_to_node(idx) :
+						   NUMA_NO_NODE);
+	if (IS_ERR(q))
+		return PTR_ERR(q);
+
+	q->xdp = true;
+	q->xdp_locked = priv->num_xdp_queues < nr_cpu_ids;
+	spin_lock_init(&q->xdp_lock);
+	priv->xdp_tx_queue[idx] = q;
+
+	param.rngcnt_idx = priv->tx_rngcnt_idx;
+	param.dma_addr = q->ring.dma_addr;
+	param.vid = 0;
+	param.irq_en = 0;
+	param.intr_aggr = 0;
+	rv = onic_qdma_init_tx_queue(priv->hw.qdma, q->qid, &param);
+	if (rv < 0)
+		onic_clear_xdp_tx_queue(priv, idx);
+
+	return rv;
+}
+
+/**
+ * onic_disable_rx_queue - stop an RX queue from receiving
+ * @priv: pointer to driver private data
+ * @qid: queue ID
+ *
+ * Once NAPI is disabled, no more XDP_TX frames are sent from the queue, and
+ * the TX queues holding its pages may be drained before the page pool goes
+ * away with onic_free_rx_queue.
+ **/
+static void onic_disable_rx_queue(struct onic_private *priv, u16 qid)
 {
 	struct onic_rx_queue *q = priv->rx_queue[qid];
-	struct onic_ring *ring;
-	u32 size, real_count;
-	int i;
 
 	if (!q)
 		return;
 
 	onic_qdma_clear_rx_queue(priv->hw.qdma, qid);
 
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 8, 0)
+	netif_queue_set_napi(priv->netdev, qid, NETDEV_QUEUE_TYPE_RX, NULL);
+#endif
 	napi_disable(&q->napi);
 	netif_napi_del(&q->napi);
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 3, 0)
+	cancel_work_sync(&q->dim.work);
+#endif
+}
+
+/**
+ * onic_free_rx_queue - free the rings and buffers of a disabled RX queue
+ * @priv: pointer to driver private data
+ * @qid: queue ID
+ **/
+static void onic_free_rx_queue(struct onic_private *priv, u16 qid)
+{
+	struct onic_rx_queue *q = priv->rx_queue[qid];
+	struct onic_ring *ring;
+	u32 size, real_count;
+	int i;
+
+	if (!q)
+		return;
 
 	ring = &q->desc_ring;
 	real_count = ring->count - 1;
@@ -722,20 +1852,27 @@ static void onic_clear_rx_queue(struct onic_private *priv, u16 qid)
 		dma_free_coherent(&priv->pdev->dev, size, ring->desc,
 				  ring->dma_addr);
 
+	for (i = 0; q->buffer && i < real_count; ++i) {
+		struct page *pg = q->buffer[i].pg;
+
+		if (pg)
+			page_pool_put_full_page(q->page_pool, pg, false);
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 10, 0)
+		if (q->buffer[i].xdp)
+			xsk_buff_free(q->buffer[i].xdp);
+#endif
+	}
+
 	ring = &q->cmpl_ring;
 	real_count = ring->count - 1;
-	size = QDMA_C2H_CMPL_SIZE * real_count + QDMA_C2H_CMPL_STAT_SIZE;
+	size = QDMA_C2H_CMPL_ENTRY_SIZE(q->cmpl_desc_sz) * real_count +
+	       QDMA_C2H_CMPL_STAT_SIZE;
 	size = ALIGN(size, PAGE_SIZE);
 
 	if (ring->desc)
 		dma_free_coherent(&priv->pdev->dev, size, ring->desc,
 				  ring->dma_addr);
 
-	for (i = 0; i < real_count; ++i) {
-		struct page *pg = q->buffer[i].pg;
-		page_pool_put_full_page(q->page_pool, pg, false);
-	}
-
 	if (q->buffer) kfree(q->buffer);
 	if (xdp_rxq_info_is_reg(&q->xdp_rxq))
 		xdp_rxq_info_unreg(&q->xdp_rxq);
@@ -745,6 +1882,12 @@ static void onic_clear_rx_queue(struct onic_private *priv, u16 qid)
 	priv->rx_queue[qid] = NULL;
 }
 
+static void onic_clear_rx_queue(struct onic_private *priv, u16 qid)
+{
+	onic_disable_rx_queue(priv, qid);
+	onic_free_rx_queue(priv, qid);
+}
+
 
 static int onic_create_page_pool(struct onic_private *priv, struct onic_rx_queue *q, int size) {
 	struct bpf_prog *xdp_prog = READ_ONCE(priv->xdp_prog);
@@ -752,14 +1895,23 @@ static int onic_create_page_pool(struct onic_private *priv, struct onic_rx_queue
 		.order = 0,
 		.flags = PP_FLAG_DMA_MAP | PP_FLAG_DMA_SYNC_DEV,
 		.pool_size = size,
-		.nid = dev_to_node(&priv->pdev->dev),
+		.nid = q->vector->numa_node,
 		.dev = &priv->pdev->dev,
 		.dma_dir = xdp_prog ? DMA_BIDIRECTIONAL : DMA_FROM_DEVICE,
 		.offset = XDP_PACKET_HEADROOM,
-		.max_len = priv->netdev->mtu + ETH_HLEN,
+		.max_len = q->bufsz,
 	};
 	int err;
 
+	/* fragments of a page are synced as a whole when it is recycled */
+	if (q->page_frag) {
+#if LINUX_VERSION_CODE < KERNEL_VERSION(6, 7, 0)
+		pp_params.flags |= PP_FLAG_PAGE_FRAG;
+#endif
+		pp_params.offset = 0;
+		pp_params.max_len = PAGE_SIZE;
+	}
+
 	q->page_pool = page_pool_create(&pp_params);
 	if (IS_ERR(q->page_pool)) {
 		err = PTR_ERR(q->page_pool);
@@ -786,20 +1938,39 @@ err_free_pp:
 	return err;
 }
 
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 10, 0)
+static int onic_init_xsk_rxq(struct onic_private *priv, struct onic_rx_queue *q)
+{
+	int err;
+
+	err = xdp_rxq_info_reg(&q->xdp_rxq, priv->netdev, q->qid, 0);
+	if (err < 0)
+		return err;
+
+	err = xdp_rxq_info_reg_mem_model(&q->xdp_rxq, MEM_TYPE_XSK_BUFF_POOL,
+					 NULL);
+	if (err) {
+		xdp_rxq_info_unreg(&q->xdp_rxq);
+		return err;
+	}
+
+	xsk_pool_set_rxq_info(q->xsk_pool, &q->xdp_rxq);
+	return 0;
+}
+#endif
+
 static int onic_init_rx_queue(struct onic_private *priv, u16 qid)
 {
-	// TODO: make these configurable via ethtool
-	const u8 bufsz_idx = 8;
-	const u8 desc_rngcnt_idx = 8;
-	//const u8 cmpl_rngcnt_idx = 15;
-	const u8 cmpl_rngcnt_idx = 8;
+	const u8 desc_rngcnt_idx = priv->rx_rngcnt_idx;
+	const u8 cmpl_rngcnt_idx = priv->cmpl_rngcnt_idx;
 	struct net_device *dev = priv->netdev;
 	struct onic_rx_queue *q;
 	struct onic_ring *ring;
 	struct onic_qdma_c2h_param param;
 	u16 vid;
-	u32 size, real_count;
-	int i, rv;
+	u32 size, real_count, max_len;
+	u8 bufsz_idx;
+	int rv;
 	bool debug = 0;
 
 	if (priv->rx_queue[qid]) {
@@ -808,18 +1979,46 @@ static int onic_init_rx_queue(struct onic_private *priv, u16 qid)
 		onic_clear_rx_queue(priv, qid);
 	}
 
-	q = kzalloc(sizeof(struct onic_rx_queue), GFP_KERNEL);
-	if (!q)
-		return -ENOMEM;
-
 	/* evenly assign to RX queues available vectors */
 	vid = qid % priv->num_q_vectors;
 
+	q = kzalloc_node(sizeof(struct onic_rx_queue), GFP_KERNEL,
+			 priv->q_vector[vid]->numa_node);
+	if (!q)
+		return -ENOMEM;
+
 	q->netdev = dev;
 	q->vector = priv->q_vector[vid];
 	q->qid = qid;
 
 	q->xdp_prog = priv->xdp_prog;
+	q->xsk_pool = onic_xsk_pool(priv, qid);
+	q->cmpl_desc_sz = priv->cmpl_desc_sz;
+	q->coal = priv->rx_coal;
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 3, 0)
+	INIT_WORK(&q->dim.work, onic_rx_dim_work);
+	q->dim.mode = DIM_CQ_PERIOD_MODE_START_FROM_EQE;
+#endif
+
+	/* XDP needs headroom and tailroom around the data, which leaves less
+	 * than ONIC_RX_FRAG_SIZE of data in half a page
+	 */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 15, 0)
+	q->page_frag = !q->xdp_prog && PAGE_SIZE >= 2 * ONIC_RX_FRAG_SIZE;
+#endif
+
+	max_len = q->page_frag ? ONIC_RX_FRAG_SIZE : ONIC_RX_BUF_MAX_LEN;
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 10, 0)
+	if (q->xsk_pool)
+		max_len = xsk_pool_get_rx_frame_size(q->xsk_pool);
+#endif
+
+	/* frames that do not fit in one C2H buffer span several descriptors */
+	rv = onic_c2h_bufsz_idx(ONIC_RX_FRAME_LEN(dev->mtu), max_len);
+	if (rv < 0)
+		goto clear_rx_queue;
+	bufsz_idx = rv;
+	q->bufsz = onic_c2h_bufsz(bufsz_idx);
 
 	/* allocate DMA memory for RX descriptor ring */
 	ring = &q->desc_ring;
@@ -828,8 +2027,8 @@ static int onic_init_rx_queue(struct onic_private *priv, u16 qid)
 
 	size = QDMA_C2H_ST_DESC_SIZE * real_count + QDMA_WB_STAT_SIZE;
 	size = ALIGN(size, PAGE_SIZE);
-	ring->desc = dma_alloc_coherent(&priv->pdev->dev, size, &ring->dma_addr,
-					GFP_KERNEL);
+	ring->desc = onic_dma_alloc_node(&priv->pdev->dev, size,
+					 &ring->dma_addr, q->vector->numa_node);
 	if (!ring->desc) {
 		rv = -ENOMEM;
 		goto clear_rx_queue;
@@ -841,57 +2040,39 @@ static int onic_init_rx_queue(struct onic_private *priv, u16 qid)
 	ring->color = 0;
 
 	/* initialize RX buffers */
-	q->buffer =
-		kcalloc(real_count, sizeof(struct onic_rx_buffer), GFP_KERNEL);
+	q->buffer = kcalloc_node(real_count, sizeof(struct onic_rx_buffer),
+				 GFP_KERNEL, q->vector->numa_node);
 	if (!q->buffer) {
 		rv = -ENOMEM;
 		goto clear_rx_queue;
 	}
 
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 10, 0)
+	if (q->xsk_pool)
+		rv = onic_init_xsk_rxq(priv, q);
+	else
+#endif
 	rv = onic_create_page_pool(priv, q, real_count);
 	if (rv < 0)
 		goto clear_rx_queue;
-	
-
-	for (i = 0; i < real_count; ++i) {
-		struct page *pg = page_pool_dev_alloc_pages(q->page_pool);
-
-		if (!pg) {
-			netdev_err(dev, "page_pool_dev_alloc_pages failed at %d", i);
-			rv = -ENOMEM;
-			goto clear_rx_queue;
-		}
-
-		q->buffer[i].pg = pg;
-		q->buffer[i].offset = XDP_PACKET_HEADROOM;
-	}
-
-	/* map pages and initialize descriptors */
-	for (i = 0; i < real_count; ++i) {
-		u8 *desc_ptr = ring->desc + QDMA_C2H_ST_DESC_SIZE * i;
-		struct qdma_c2h_st_desc desc;
-		struct page *pg = q->buffer[i].pg;
-		unsigned int offset = q->buffer[i].offset;
-
-		desc.dst_addr = page_pool_get_dma_addr(pg) + offset;
-		qdma_pack_c2h_st_desc(desc_ptr, &desc);
-	}
 
 	/* allocate DMA memory for completion ring */
 	ring = &q->cmpl_ring;
 	ring->count = onic_ring_count(cmpl_rngcnt_idx);
 	real_count = ring->count - 1;
 
-	size = QDMA_C2H_CMPL_SIZE * real_count + QDMA_C2H_CMPL_STAT_SIZE;
+	size = QDMA_C2H_CMPL_ENTRY_SIZE(q->cmpl_desc_sz) * real_count +
+	       QDMA_C2H_CMPL_STAT_SIZE;
 	size = ALIGN(size, PAGE_SIZE);
-	ring->desc = dma_alloc_coherent(&priv->pdev->dev, size, &ring->dma_addr,
-					GFP_KERNEL);
+	ring->desc = onic_dma_alloc_node(&priv->pdev->dev, size,
+					 &ring->dma_addr, q->vector->numa_node);
 	if (!ring->desc) {
 		rv = -ENOMEM;
 		goto clear_rx_queue;
 	}
 	memset(ring->desc, 0, size);
-	ring->wb = ring->desc + QDMA_C2H_CMPL_SIZE * real_count;
+	ring->wb = ring->desc +
+		   QDMA_C2H_CMPL_ENTRY_SIZE(q->cmpl_desc_sz) * real_count;
 	ring->next_to_use = 0;
 	ring->next_to_clean = 0;
 	ring->color = 1;
@@ -902,15 +2083,20 @@ static int onic_init_rx_queue(struct onic_private *priv, u16 qid)
 	netif_napi_add(dev, &q->napi, onic_rx_poll, 64);
 #endif
 	napi_enable(&q->napi);
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 8, 0)
+	netif_queue_set_napi(dev, qid, NETDEV_QUEUE_TYPE_RX, &q->napi);
+#endif
 
 	/* initialize QDMA C2H queue */
 	param.bufsz_idx = bufsz_idx;
 	param.desc_rngcnt_idx = desc_rngcnt_idx;
 	param.cmpl_rngcnt_idx = cmpl_rngcnt_idx;
-	param.cmpl_desc_sz = 0;
+	param.cmpl_desc_sz = q->cmpl_desc_sz;
+	param.coal = q->coal;
 	param.desc_dma_addr = q->desc_ring.dma_addr;
 	param.cmpl_dma_addr = q->cmpl_ring.dma_addr;
 	param.vid = vid;
+	param.intr_aggr = test_bit(ONIC_FLAG_INTR_AGGR, priv->flags);
 	if (debug)
 		netdev_info(
 			dev,
@@ -922,10 +2108,29 @@ static int onic_init_rx_queue(struct onic_private *priv, u16 qid)
 	if (rv < 0)
 		goto clear_rx_queue;
 
-	/* fill RX descriptor ring with a few descriptors */
-	q->desc_ring.next_to_use = ONIC_RX_DESC_STEP;
-	onic_set_rx_head(priv->hw.qdma, qid, q->desc_ring.next_to_use);
-	onic_set_completion_tail(priv->hw.qdma, qid, 0, 1);
+	/* fill the whole RX descriptor ring */
+	if (onic_rx_alloc_buffers(q)) {
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 10, 0)
+		/* user space usually fills the fill ring only after binding
+		 * the socket, so the rest is refilled once it has
+		 */
+		if (q->xsk_pool) {
+			if (xsk_uses_need_wakeup(q->xsk_pool)) {
+				xsk_set_rx_need_wakeup(q->xsk_pool);
+			} else {
+				local_bh_disable();
+				napi_schedule(&q->napi);
+				local_bh_enable();
+			}
+		} else
+#endif
+		{
+			netdev_err(dev, "Failed to fill RX queue %d", qid);
+			rv = -ENOMEM;
+			goto clear_rx_queue;
+		}
+	}
+	onic_set_completion_tail(priv->hw.qdma, qid, 0, &q->coal, 1);
 
 	priv->rx_queue[qid] = q;
 	return 0;
@@ -957,6 +2162,29 @@ clear_tx_resource:
 	return rv;
 }
 
+static int onic_init_xdp_tx_resource(struct onic_private *priv)
+{
+	struct net_device *dev = priv->netdev;
+	int idx, rv;
+
+	for (idx = 0; idx < priv->num_xdp_queues; ++idx) {
+		rv = onic_init_xdp_tx_queue(priv, idx);
+		if (!rv)
+			continue;
+
+		netdev_err(dev, "onic_init_xdp_tx_queue %d, err = %d", idx,
+			   rv);
+		goto clear_xdp_tx_resource;
+	}
+
+	return 0;
+
+clear_xdp_tx_resource:
+	while (idx--)
+		onic_clear_xdp_tx_queue(priv, idx);
+	return rv;
+}
+
 static int onic_init_rx_resource(struct onic_private *priv)
 {
 	struct net_device *dev = priv->netdev;
@@ -984,6 +2212,17 @@ int onic_open_netdev(struct net_device *dev)
 	struct onic_private *priv = netdev_priv(dev);
 	int rv;
 
+	/* XDP TX queues only exist while an XDP program, which zero-copy
+	 * queues also need, is attached.  Frames redirected to the device
+	 * otherwise go to the stack TX queues
+	 */
+	if (priv->xdp_prog && priv->num_xdp_queues) {
+		rv = onic_init_xdp_tx_resource(priv);
+		if (rv < 0)
+			goto stop_netdev;
+		set_bit(ONIC_XDP_TX_QUEUES, priv->state);
+	}
+
 	rv = onic_init_tx_resource(priv);
 	if (rv < 0)
 		goto stop_netdev;
@@ -992,6 +2231,7 @@ int onic_open_netdev(struct net_device *dev)
 	if (rv < 0)
 		goto stop_netdev;
 
+	clear_bit(ONIC_DOWN, priv->state);
 	netif_tx_start_all_queues(dev);
 	netif_carrier_on(dev);
 	return 0;
@@ -1006,15 +2246,291 @@ int onic_stop_netdev(struct net_device *dev)
 	struct onic_private *priv = netdev_priv(dev);
 	int qid;
 
-	/* stop sending */
+	/* stop sending, onic_tx_poll no longer wakes the queues and
+	 * onic_xdp_xmit refuses new frames
+	 */
+	set_bit(ONIC_DOWN, priv->state);
 	netif_carrier_off(dev);
-	netif_tx_stop_all_queues(dev);
-
+	netif_tx_disable(dev);
+	/* wait for ndo_xdp_xmit callers still on the TX queues */
+	synchronize_net();
+
+	/* XDP_TX from the RX queues is over once their NAPI is disabled, and
+	 * the TX rings still holding page pool pages are drained before the
+	 * pools are destroyed.  All TX NAPIs are disabled before any ring is
+	 * freed.
+	 */
+	for (qid = 0; qid < priv->num_rx_queues; ++qid)
+		onic_disable_rx_queue(priv, qid);
 	for (qid = 0; qid < priv->num_tx_queues; ++qid)
-		onic_clear_tx_queue(priv, qid);
+		onic_disable_tx_queue(priv, qid);
+	for (qid = 0; qid < priv->num_tx_queues; ++qid)
+		onic_free_tx_queue(priv, qid);
+	clear_bit(ONIC_XDP_TX_QUEUES, priv->state);
+	for (qid = 0; qid < priv->num_xdp_queues; ++qid)
+		onic_clear_xdp_tx_queue(priv, qid);
 	for (qid = 0; qid < priv->num_rx_queues; ++qid)
-		onic_clear_rx_queue(priv, qid);
+		onic_free_rx_queue(priv, qid);
+
+	return 0;
+}
+
+/**
+ * onic_tx_put_desc - write an H2C descriptor for part of an skb
+ * @q: pointer to TX queue
+ * @ntu: descriptor index
+ * @type: TX buffer type, telling how the data is unmapped
+ * @dma_addr: DMA address of the data
+ * @len: data length
+ * @pkt_len: length of the packet on the wire
+ **/
+static void onic_tx_put_desc(struct onic_tx_queue *q, u16 ntu,
+			     enum onic_tx_buf_type type, dma_addr_t dma_addr,
+			     u32 len, u32 pkt_len)
+{
+	struct onic_tx_buffer *buf = &q->buffer[ntu];
+	struct qdma_h2c_st_desc desc;
+
+	/* every descriptor of a packet carries the packet length */
+	desc.len = len;
+	desc.src_addr = dma_addr;
+	desc.metadata = pkt_len;
+	qdma_pack_h2c_st_desc(q->ring.desc + QDMA_H2C_ST_DESC_SIZE * ntu, &desc);
+
+	buf->type = type;
+	buf->skb = NULL;
+	buf->dma_addr = dma_addr;
+	buf->len = len;
+	buf->bytecount = 0;
+	buf->gso_segs = 0;
+}
+
+/**
+ * onic_tx_copy_skb - copy a small packet into the slot of its descriptor
+ * @q: pointer to TX queue
+ * @skb: packet to send
+ *
+ * The slot is mapped for the lifetime of the queue, which saves the per-packet
+ * DMA mapping.  The checksum is completed and the packet padded while
+ * copying.  Return the index following the descriptor.
+ **/
+static int onic_tx_copy_skb(struct onic_tx_queue *q, struct sk_buff *skb)
+{
+	u16 ntu = q->ring.next_to_use;
+	u32 len = max_t(u32, skb->len, ETH_ZLEN);
+	dma_addr_t dma_addr;
+	u8 *slot = onic_tx_slot(q, ntu, &dma_addr);
+
+	skb_copy_and_csum_dev(skb, slot);
+	if (skb->len < ETH_ZLEN)
+		memset(slot + skb->len, 0, ETH_ZLEN - skb->len);
+
+	onic_tx_put_desc(q, ntu, ONIC_TX_BOUNCE, dma_addr, len, len);
+
+	return (ntu + 1) % onic_ring_get_real_count(&q->ring);
+}
+
+/**
+ * onic_tx_unwind - unmap descriptors written but not handed to hardware
+ * @q: pointer to TX queue
+ * @ntu: index following the last written descriptor
+ **/
+static void onic_tx_unwind(struct onic_tx_queue *q, u16 ntu)
+{
+	struct onic_private *priv = netdev_priv(q->netdev);
+	u16 real_count = onic_ring_get_real_count(&q->ring);
+
+	while (ntu != q->ring.next_to_use) {
+		ntu = (ntu + real_count - 1) % real_count;
+		onic_tx_unmap(&priv->pdev->dev, &q->buffer[ntu]);
+	}
+}
+
+/**
+ * onic_tx_map_skb - map the head and frags of an skb to H2C descriptors
+ * @q: pointer to TX queue
+ * @skb: packet to send
+ *
+ * Return the index following the last descriptor, negative on failure
+ **/
+static int onic_tx_map_skb(struct onic_tx_queue *q, struct sk_buff *skb)
+{
+	struct onic_private *priv = netdev_priv(q->netdev);
+	struct device *dev = &priv->pdev->dev;
+	u16 real_count = onic_ring_get_real_count(&q->ring);
+	u16 ntu = q->ring.next_to_use;
+	int nr_frags = skb_shinfo(skb)->nr_frags;
+	enum onic_tx_buf_type type;
+	dma_addr_t dma_addr;
+	u32 len;
+	int i;
+
+	for (i = 0; i <= nr_frags; i++) {
+		if (i == 0) {
+			len = skb_headlen(skb);
+			dma_addr = dma_map_single(dev, skb->data, len,
+						  DMA_TO_DEVICE);
+			type = ONIC_TX_SKB;
+		} else {
+			const skb_frag_t *frag = &skb_shinfo(skb)->frags[i - 1];
+
+			len = skb_frag_size(frag);
+			dma_addr = skb_frag_dma_map(dev, frag, 0, len,
+						    DMA_TO_DEVICE);
+			type = ONIC_TX_SKB_FRAG;
+		}
+
+		if (unlikely(dma_mapping_error(dev, dma_addr))) {
+			onic_tx_unwind(q, ntu);
+			return -ENOMEM;
+		}
+
+		onic_tx_put_desc(q, ntu, type, dma_addr, len, skb->len);
+		ntu = (ntu + 1) % real_count;
+	}
+
+	return ntu;
+}
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 9, 0)
+/**
+ * onic_tso_csum - fill in the checksums of a TSO segment
+ * @skb: TSO or UDP GSO packet
+ * @tso: TSO state
+ * @hdr: segment headers built by tso_build_hdr
+ * @hdr_len: length of the segment headers
+ * @seg_len: payload length of the segment
+ * @csum: checksum of the segment payload
+ *
+ * The shell has no checksum offload, so the IPv4 header and L4 checksums
+ * hardware would insert are computed here.
+ **/
+static void onic_tso_csum(const struct sk_buff *skb, const struct tso_t *tso,
+			  u8 *hdr, int hdr_len, int seg_len, __wsum csum)
+{
+	int l4_off = skb_transport_offset(skb);
+	int l4_len = hdr_len - l4_off + seg_len;
+	__sum16 *check = (__sum16 *)(hdr + l4_off + skb->csum_offset);
+	bool udp = skb_shinfo(skb)->gso_type & SKB_GSO_UDP_L4;
+	u8 proto = udp ? IPPROTO_UDP : IPPROTO_TCP;
+
+	*check = 0;
+	csum = csum_partial(hdr + l4_off, hdr_len - l4_off, csum);
+
+	if (tso->ipv6) {
+		struct ipv6hdr *ip6h =
+			(struct ipv6hdr *)(hdr + skb_network_offset(skb));
+
+		*check = csum_ipv6_magic(&ip6h->saddr, &ip6h->daddr, l4_len,
+					 proto, csum);
+	} else {
+		struct iphdr *iph =
+			(struct iphdr *)(hdr + skb_network_offset(skb));
+
+		ip_send_check(iph);
+		*check = csum_tcpudp_magic(iph->saddr, iph->daddr, l4_len,
+					   proto, csum);
+	}
+
+	if (udp && !*check)
+		*check = CSUM_MANGLED_0;
+}
+
+/**
+ * onic_tx_tso - segment a TSO or UDP GSO skb into H2C descriptors
+ * @q: pointer to TX queue
+ * @skb: packet to send
+ * @bytes: returns the number of bytes sent on the wire
+ *
+ * Every segment gets its headers rebuilt in the header slot of its first
+ * descriptor, followed by payload descriptors pointing into the skb.
+ * Return the index following the last descriptor, negative on failure
+ **/
+static int onic_tx_tso(struct onic_tx_queue *q, struct sk_buff *skb,
+		       unsigned int *bytes)
+{
+	struct onic_private *priv = netdev_priv(q->netdev);
+	struct device *dev = &priv->pdev->dev;
+	u16 real_count = onic_ring_get_real_count(&q->ring);
+	u16 ntu = q->ring.next_to_use;
+	int hdr_len, total_len;
+	struct tso_t tso;
+
+	BUILD_BUG_ON(TSO_HEADER_SIZE > ONIC_TX_SLOT_SIZE);
+
+	hdr_len = tso_start(skb, &tso);
+	total_len = skb->len - hdr_len;
+	*bytes = skb->len + (skb_shinfo(skb)->gso_segs - 1) * hdr_len;
+
+	while (total_len > 0) {
+		int seg_len = min_t(int, skb_shinfo(skb)->gso_size, total_len);
+		dma_addr_t hdr_dma;
+		u8 *hdr = onic_tx_slot(q, ntu, &hdr_dma);
+		int data_left = seg_len;
+		__wsum csum = 0;
+
+		total_len -= seg_len;
+		tso_build_hdr(skb, hdr, &tso, seg_len, total_len == 0);
+		onic_tx_put_desc(q, ntu, ONIC_TX_TSO_HDR, hdr_dma,
+				 hdr_len, hdr_len + seg_len);
+		ntu = (ntu + 1) % real_count;
+
+		while (data_left > 0) {
+			int size = min_t(int, tso.size, data_left);
+			dma_addr_t dma_addr;
+
+			csum = csum_block_add(csum,
+					      csum_partial(tso.data, size, 0),
+					      seg_len - data_left);
+
+			dma_addr = dma_map_single(dev, tso.data, size,
+						  DMA_TO_DEVICE);
+			if (unlikely(dma_mapping_error(dev, dma_addr))) {
+				onic_tx_unwind(q, ntu);
+				return -ENOMEM;
+			}
+
+			onic_tx_put_desc(q, ntu, ONIC_TX_SKB, dma_addr, size,
+					 hdr_len + seg_len);
+			ntu = (ntu + 1) % real_count;
+
+			data_left -= size;
+			tso_build_data(skb, &tso, size);
+		}
+
+		onic_tso_csum(skb, &tso, hdr, hdr_len, seg_len, csum);
+	}
 
+	return ntu;
+}
+#endif
+
+/**
+ * onic_maybe_stop_tx - stop a TX queue running out of descriptors
+ * @q: pointer to TX queue
+ * @nq: netdev queue of the TX queue
+ * @size: number of descriptors needed
+ *
+ * The ring is checked again after stopping, in case onic_tx_poll freed
+ * descriptors without seeing the queue stopped.  Return 0 if @size
+ * descriptors are available, -EBUSY with the queue stopped otherwise.
+ **/
+static int onic_maybe_stop_tx(struct onic_tx_queue *q,
+			      struct netdev_queue *nq, int size)
+{
+	if (likely(onic_ring_unused(&q->ring) >= size))
+		return 0;
+
+	netif_tx_stop_queue(nq);
+
+	/* pairs with the barrier in onic_tx_poll */
+	smp_mb();
+
+	if (likely(onic_ring_unused(&q->ring) < size))
+		return -EBUSY;
+
+	/* raced with onic_tx_poll freeing descriptors */
+	netif_tx_start_queue(nq);
 	return 0;
 }
 
@@ -1023,70 +2539,104 @@ netdev_tx_t onic_xmit_frame(struct sk_buff *skb, struct net_device *dev)
 	struct onic_private *priv = netdev_priv(dev);
 	struct onic_tx_queue *q;
 	struct onic_ring *ring;
-	struct qdma_h2c_st_desc desc;
+	struct onic_tx_buffer *buf;
+	struct netdev_queue *nq;
 	u16 qid = skb->queue_mapping;
-	dma_addr_t dma_addr;
-	u8 *desc_ptr;
-	int rv;
+	u16 real_count;
+	unsigned int packets = 1, bytes;
+	int nr_descs, rv;
 	bool debug = 0;
 	struct rtnl_link_stats64 *pcpu_stats_pointer;
 	pcpu_stats_pointer = this_cpu_ptr(priv->netdev_stats);
 	q = priv->tx_queue[qid];
 	ring = &q->ring;
-	
-	onic_tx_clean(q);
-
-	if (onic_ring_full(ring)) {
+	real_count = onic_ring_get_real_count(ring);
+	nq = netdev_get_tx_queue(dev, qid);
+
+	/* one descriptor for the head and one for each frag */
+	nr_descs = skb_shinfo(skb)->nr_frags + 1;
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 9, 0)
+	if (skb_is_gso(skb))
+		nr_descs = tso_count_descs(skb);
+#endif
+	/* the queue is stopped ahead of time below, so this is not expected */
+	if (unlikely(onic_maybe_stop_tx(q, nq, nr_descs))) {
 		if (debug)
 			netdev_info(dev, "ring is full");
 		return NETDEV_TX_BUSY;
 	}
 
-	/* minimum Ethernet packet length is 60 */
-	rv = skb_put_padto(skb, ETH_ZLEN);
-
-	if (rv < 0)
-		netdev_err(dev, "skb_put_padto failed, err = %d", rv);
-
-	dma_addr = dma_map_single(&priv->pdev->dev, skb->data, skb->len,
-				  DMA_TO_DEVICE);
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 9, 0)
+	if (skb_is_gso(skb)) {
+		packets = skb_shinfo(skb)->gso_segs;
+		rv = onic_tx_tso(q, skb, &bytes);
+	} else
+#endif
+	if (skb->len <= READ_ONCE(priv->tx_copybreak)) {
+		bytes = max_t(u32, skb->len, ETH_ZLEN);
+		rv = onic_tx_copy_skb(q, skb);
+	} else {
+		/* checksum offload is advertised for SG and TSO, but done
+		 * in software as the shell has none
+		 */
+		if (skb->ip_summed == CHECKSUM_PARTIAL &&
+		    skb_checksum_help(skb))
+			goto drop;
+
+		/* minimum Ethernet packet length is 60, the skb is freed on
+		 * failure
+		 */
+		if (skb_put_padto(skb, ETH_ZLEN)) {
+			pcpu_stats_pointer->tx_dropped++;
+			return NETDEV_TX_OK;
+		}
 
-	if (unlikely(dma_mapping_error(&priv->pdev->dev, dma_addr))) {
-		dev_kfree_skb(skb);
-		pcpu_stats_pointer->tx_dropped++;
-		pcpu_stats_pointer->tx_errors++;
-		return NETDEV_TX_OK;
+		bytes = skb->len;
+		rv = onic_tx_map_skb(q, skb);
 	}
+	if (rv < 0)
+		goto drop;
 
-	desc_ptr = ring->desc + QDMA_H2C_ST_DESC_SIZE * ring->next_to_use;
-	desc.len = skb->len;
-	desc.src_addr = dma_addr;
-	desc.metadata = skb->len;
-	qdma_pack_h2c_st_desc(desc_ptr, &desc);
-
-	q->buffer[ring->next_to_use].type = ONIC_TX_SKB;
-	q->buffer[ring->next_to_use].skb = skb;
-	q->buffer[ring->next_to_use].dma_addr = dma_addr;
-	q->buffer[ring->next_to_use].len = skb->len;
+	/* the skb is released with its last descriptor, unless copied */
+	buf = &q->buffer[(rv + real_count - 1) % real_count];
+	if (buf->type != ONIC_TX_BOUNCE)
+		buf->skb = skb;
+	buf->bytecount = bytes;
+	buf->gso_segs = packets;
+	ring->next_to_use = rv;
 
-	pcpu_stats_pointer->tx_packets++;
-	pcpu_stats_pointer->tx_bytes += skb->len;
+	pcpu_stats_pointer->tx_packets += packets;
+	pcpu_stats_pointer->tx_bytes += bytes;
 
-	onic_ring_increment_head(ring);
+	/* stop while the next packet may not fit, woken up again from
+	 * onic_tx_poll once enough descriptors are cleaned
+	 */
+	onic_maybe_stop_tx(q, nq, ONIC_TX_DESCS_NEEDED);
 
+	/* BQL may stop the queue as well, the doorbell is written if it did */
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 3, 0)
-	if (onic_ring_full(ring) || !netdev_xmit_more()) {
+	if (__netdev_tx_sent_queue(nq, bytes, netdev_xmit_more())) {
 #elif defined(RHEL_RELEASE_CODE)
 #if RHEL_RELEASE_CODE >= RHEL_RELEASE_VERSION(8, 1)
-        if (onic_ring_full(ring) || !netdev_xmit_more()) {
+        if (__netdev_tx_sent_queue(nq, bytes, netdev_xmit_more())) {
 #endif
 #else
-	if (onic_ring_full(ring) || !skb->xmit_more) {
+	netdev_tx_sent_queue(nq, bytes);
+	if (netif_xmit_stopped(nq) || !skb->xmit_more) {
 #endif
 		wmb();
-		onic_set_tx_head(priv->hw.qdma, qid, ring->next_to_use);
+		onic_set_tx_head(priv->hw.qdma, qid, ring->next_to_use, 0);
 	}
 
+	if (buf->type == ONIC_TX_BOUNCE)
+		dev_consume_skb_any(skb);
+
+	return NETDEV_TX_OK;
+
+drop:
+	dev_kfree_skb_any(skb);
+	pcpu_stats_pointer->tx_dropped++;
+	pcpu_stats_pointer->tx_errors++;
 	return NETDEV_TX_OK;
 }
 
@@ -1109,10 +2659,56 @@ int onic_do_ioctl(struct net_device *dev, struct ifreq *ifr, int cmd)
 	return 0;
 }
 
+/**
+ * onic_xdp_mtu_ok - check that an XDP program can handle the MTU
+ * @prog: XDP program
+ * @mtu: MTU to check
+ *
+ * Programs without frags support are only given single-buffer packets, so
+ * the whole frame must fit in one C2H buffer.
+ **/
+static bool onic_xdp_mtu_ok(struct bpf_prog *prog, int mtu)
+{
+	int idx;
+
+	if (onic_xdp_has_frags(prog))
+		return true;
+
+	idx = onic_c2h_bufsz_idx(ONIC_RX_FRAME_LEN(mtu), ONIC_RX_BUF_MAX_LEN);
+
+	return idx >= 0 && onic_c2h_bufsz(idx) >= ONIC_RX_FRAME_LEN(mtu);
+}
+
 int onic_change_mtu(struct net_device *dev, int mtu)
 {
+	struct onic_private *priv = netdev_priv(dev);
+	bool running = netif_running(dev);
+	int old_mtu = dev->mtu;
+	int rv;
+
+	if (priv->xdp_prog && !onic_xdp_mtu_ok(priv->xdp_prog, mtu)) {
+		netdev_err(dev, "MTU %d is too large for XDP", mtu);
+		return -EINVAL;
+	}
+
 	netdev_info(dev, "Requested MTU = %d", mtu);
-	return 0;
+
+	if (!running) {
+		WRITE_ONCE(dev->mtu, mtu);
+		return 0;
+	}
+
+	/* RX buffers are sized at queue initialization */
+	onic_stop_netdev(dev);
+	WRITE_ONCE(dev->mtu, mtu);
+	rv = onic_open_netdev(dev);
+	if (rv < 0) {
+		netdev_err(dev, "Failed to apply MTU %d, err = %d", mtu, rv);
+		WRITE_ONCE(dev->mtu, old_mtu);
+		onic_open_netdev(dev);
+	}
+
+	return rv;
 }
 
 inline void onic_get_stats64(struct net_device *dev, struct rtnl_link_stats64 *stats)
@@ -1131,6 +2727,8 @@ inline void onic_get_stats64(struct net_device *dev, struct rtnl_link_stats64 *s
 		total_stats.tx_bytes += pcpu_ptr->tx_bytes;
 		total_stats.tx_errors += pcpu_ptr->tx_errors;
 		total_stats.tx_dropped += pcpu_ptr->tx_dropped;
+		total_stats.rx_errors += pcpu_ptr->rx_errors;
+		total_stats.rx_dropped += pcpu_ptr->rx_dropped;
 	}
 	
 	stats->tx_packets = total_stats.tx_packets;
@@ -1139,6 +2737,8 @@ inline void onic_get_stats64(struct net_device *dev, struct rtnl_link_stats64 *s
 	stats->rx_bytes = total_stats.rx_bytes;
 	stats->tx_dropped = total_stats.tx_dropped;
 	stats->tx_errors = total_stats.tx_errors;
+	stats->rx_dropped = total_stats.rx_dropped;
+	stats->rx_errors = total_stats.rx_errors;
 }
 
 
@@ -1148,93 +2748,264 @@ static int onic_setup_xdp_prog(struct net_device *dev, struct bpf_prog *prog) {
 	bool running = netif_running(dev);
 
 	bool need_reset;
+	struct bpf_prog *old_prog;
+	int rv;
+
+	if (prog && !onic_xdp_mtu_ok(prog, dev->mtu)) {
+		netdev_err(dev, "MTU %d is too large for XDP", dev->mtu);
+		return -EOPNOTSUPP;
+	}
 
-	struct bpf_prog *old_prog = xchg(&priv->xdp_prog, prog);
+	old_prog = xchg(&priv->xdp_prog, prog);
 	need_reset = (!!prog != !!old_prog);
 
 	if (need_reset && running) {
 		onic_stop_netdev(dev);
-	} else {
+		rv = onic_open_netdev(dev);
+		if (rv < 0) {
+			/* the caller still owns prog, go back to the old one */
+			xchg(&priv->xdp_prog, old_prog);
+			onic_open_netdev(dev);
+			return rv;
+		}
+	} else if (!need_reset) {
 		int i;
 		for (i = 0; i < priv->num_rx_queues; i++) {
-			xchg(&priv->rx_queue[i]->xdp_prog, priv->xdp_prog);
+			if (priv->rx_queue[i])
+				xchg(&priv->rx_queue[i]->xdp_prog,
+				     priv->xdp_prog);
 		}
 	}
-	if (old_prog){
+	if (old_prog)
+		bpf_prog_put(old_prog);
+
+	return 0;
+}
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 3, 0)
+/**
+ * onic_xdp_rx_hash - report the RSS hash of a packet to an XDP program
+ * @ctx: XDP context, an onic_xdp_buff
+ * @hash: RSS hash
+ * @rss_type: hashed headers
+ *
+ * The hash is only reported in wide completion entries.  The shell does not
+ * tell the IP version, so L3 hashes are reported without a type.
+ **/
+static int onic_xdp_rx_hash(const struct xdp_md *ctx, u32 *hash,
+			    enum xdp_rss_hash_type *rss_type)
+{
+	const struct onic_xdp_buff *_ctx = (const void *)ctx;
+	const struct qdma_c2h_cmpl *cmpl = _ctx->cmpl;
 
-#if LINUX_VERSION_CODE >= KERNEL_VERSION(6,3,0)
-		xdp_features_clear_redirect_target(dev);
+#if LINUX_VERSION_CODE < KERNEL_VERSION(6, 8, 0)
+	/* XSK buffers carry no completion entry before 6.8 */
+	if (_ctx->xdp.rxq->mem.type == MEM_TYPE_XSK_BUFF_POOL)
+		return -ENODATA;
 #endif
-		bpf_prog_put(old_prog);
+	if (cmpl->rss_type == QDMA_C2H_CMPL_RSS_TYPE_NONE)
+		return -ENODATA;
+
+	*hash = cmpl->rss_hash;
+	*rss_type = (cmpl->rss_type == QDMA_C2H_CMPL_RSS_TYPE_L4) ?
+		    XDP_RSS_TYPE_L4_ANY : XDP_RSS_TYPE_NONE;
+	return 0;
+}
+
+const struct xdp_metadata_ops onic_xdp_metadata_ops = {
+	.xmo_rx_hash = onic_xdp_rx_hash,
+};
+#endif
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 10, 0)
+/**
+ * onic_xsk_pool_enable - bind an AF_XDP pool to a queue pair for zero-copy
+ * @dev: pointer to network device
+ * @pool: XSK buffer pool
+ * @qid: queue ID
+ *
+ * The queues are re-created on the pool if an XDP program is running.
+ **/
+static int onic_xsk_pool_enable(struct net_device *dev,
+				struct xsk_buff_pool *pool, u16 qid)
+{
+	struct onic_private *priv = netdev_priv(dev);
+	bool reset = netif_running(dev) && priv->xdp_prog;
+	u32 frame_len = ONIC_RX_FRAME_LEN(dev->mtu);
+	int idx, rv;
+
+	if (qid >= priv->num_rx_queues || qid >= priv->num_tx_queues)
+		return -EINVAL;
+
+	/* packets spanning several XSK buffers are not supported */
+	idx = onic_c2h_bufsz_idx(frame_len, xsk_pool_get_rx_frame_size(pool));
+	if (idx < 0 || onic_c2h_bufsz(idx) < frame_len) {
+		netdev_err(dev, "AF_XDP frame too small for MTU %d", dev->mtu);
+		return -EINVAL;
 	}
 
-	if (!need_reset)
+	rv = xsk_pool_dma_map(pool, &priv->pdev->dev, 0);
+	if (rv < 0)
+		return rv;
+
+	if (!reset) {
+		set_bit(qid, priv->af_xdp_zc_qps);
 		return 0;
+	}
 
-	if (running)
+	onic_stop_netdev(dev);
+	set_bit(qid, priv->af_xdp_zc_qps);
+	rv = onic_open_netdev(dev);
+	if (rv < 0) {
+		/* bring the queues back up without the pool */
+		clear_bit(qid, priv->af_xdp_zc_qps);
+		xsk_pool_dma_unmap(pool, 0);
 		onic_open_netdev(dev);
+	}
+
+	return rv;
+}
+
+static int onic_xsk_pool_disable(struct net_device *dev, u16 qid)
+{
+	struct onic_private *priv = netdev_priv(dev);
+	bool reset = netif_running(dev) && priv->xdp_prog;
+	struct xsk_buff_pool *pool;
 
+	pool = xsk_get_pool_from_qid(dev, qid);
+	if (!pool || !test_bit(qid, priv->af_xdp_zc_qps))
+		return -EINVAL;
+
+	if (reset)
+		onic_stop_netdev(dev);
+	clear_bit(qid, priv->af_xdp_zc_qps);
+	xsk_pool_dma_unmap(pool, 0);
+	if (reset)
+		return onic_open_netdev(dev);
+
+	return 0;
+}
+
+int onic_xsk_wakeup(struct net_device *dev, u32 qid, u32 flags)
+{
+	struct onic_private *priv = netdev_priv(dev);
+	struct onic_rx_queue *rxq;
+	struct onic_tx_queue *txq;
+
+	if (!netif_running(dev) || test_bit(ONIC_DOWN, priv->state) ||
+	    !priv->xdp_prog)
+		return -ENETDOWN;
+	if (qid >= priv->num_rx_queues || qid >= priv->num_tx_queues)
+		return -EINVAL;
+
+	rxq = priv->rx_queue[qid];
+	txq = priv->tx_queue[qid];
+	if (!rxq || !txq || !rxq->xsk_pool)
+		return -EINVAL;
+
+	if ((flags & XDP_WAKEUP_RX) && !napi_if_scheduled_mark_missed(&rxq->napi))
+		napi_schedule(&rxq->napi);
+	if ((flags & XDP_WAKEUP_TX) && !napi_if_scheduled_mark_missed(&txq->napi))
+		napi_schedule(&txq->napi);
 
-#if LINUX_VERSION_CODE >= KERNEL_VERSION(6,3,0)
-	if (need_reset && prog)
-		xdp_features_set_redirect_target(dev, false);
-#endif
 	return 0;
 }
+#endif
 
 int onic_xdp(struct net_device *dev, struct netdev_bpf *xdp) {
 	switch (xdp->command) {
 		case XDP_SETUP_PROG:
 			return onic_setup_xdp_prog(dev, xdp->prog);
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 10, 0)
+		case XDP_SETUP_XSK_POOL:
+			if (xdp->xsk.pool)
+				return onic_xsk_pool_enable(dev, xdp->xsk.pool,
+							    xdp->xsk.queue_id);
+			return onic_xsk_pool_disable(dev, xdp->xsk.queue_id);
+#endif
 		default:
 			return -EINVAL;
 	}
 }
 
+/**
+ * onic_xdp_frame_descs - number of H2C descriptors taken by an XDP frame
+ * @xdpf: XDP frame
+ **/
+static int onic_xdp_frame_descs(struct xdp_frame *xdpf)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 18, 0)
+	if (unlikely(xdp_frame_has_frags(xdpf)))
+		return xdp_get_shared_info_from_frame(xdpf)->nr_frags + 1;
+#endif
+	return 1;
+}
+
+/**
+ * onic_xdp_xmit - transmit a bulk of redirected XDP frames
+ * @dev: pointer to network device
+ * @n: number of frames
+ * @frames: XDP frames
+ * @flags: XDP_XMIT_* flags
+ *
+ * Ring space is checked for the whole bulk up front, and the frames that fit
+ * are mapped and written in one pass.  Transmission stops at the first frame
+ * that does not fit or fails to map.  Return the number of frames sent; the
+ * remaining frames are returned by the caller on 5.13 and later, and here on
+ * older kernels.  Failures are only counted, a congested ring must not flood
+ * the log.
+ **/
 int onic_xdp_xmit(struct net_device *dev, int n, struct xdp_frame **frames, u32 flags) {
 	struct onic_private *priv = netdev_priv(dev);
-	struct onic_ring *tx_ring;
 	struct onic_tx_queue *tx_queue;
-	struct netdev_queue *nq;
-	int i, drops = 0, cpu;
-	
-	 
-	cpu  = smp_processor_id();
+	int i, nxmit, descs = 0;
+	u16 unused;
+
+	if (unlikely(!netif_running(dev) ||
+		     test_bit(ONIC_DOWN, priv->state)))
+		return -ENETDOWN;
 
 	tx_queue =  onic_xdp_tx_queue_mapping(priv);
+	if (unlikely(!tx_queue))
+		return -ENXIO;
 
 	if (unlikely(flags & ~XDP_XMIT_FLAGS_MASK)){
-			netdev_err(dev, "Invalid flags");
 		tx_queue->xdp_tx_stats.xdp_xmit_err++;
 		return -EINVAL;
 	}
 
-	tx_ring = &tx_queue->ring;
-	nq = netdev_get_tx_queue(tx_queue->netdev, tx_queue->qid);
+	onic_xdp_tx_lock(tx_queue);
 
-	__netif_tx_lock(nq, cpu);
-	for (i = 0; i < n; i++) {
-		struct xdp_frame *frame = frames[i];
-		int err;
+	/* reserve ring space for as many frames of the bulk as fit */
+	unused = onic_ring_unused(&tx_queue->ring);
+	for (nxmit = 0; nxmit < n; nxmit++) {
+		descs += onic_xdp_frame_descs(frames[nxmit]);
+		if (descs > unused)
+			break;
+	}
 
-		err = 0;
-		err = onic_xmit_xdp_ring(priv, tx_queue, frame, true);
-		if (err != ONIC_XDP_TX) {
-			xdp_return_frame_rx_napi(frame);
-			netdev_err(dev, "Failed to transmit frame");
-			tx_queue->xdp_tx_stats.xdp_xmit_err++;
-			drops++;
-		} else {
-			tx_queue->xdp_tx_stats.xdp_xmit++;
-		}
+	for (i = 0; i < nxmit; i++) {
+		if (onic_xmit_xdp_ring(priv, tx_queue, frames[i], true) !=
+		    ONIC_XDP_TX)
+			break;
 	}
+	nxmit = i;
 
 	if (flags & XDP_XMIT_FLUSH) {
 		wmb();
-		onic_set_tx_head(priv->hw.qdma, tx_queue->qid, tx_queue->ring.next_to_use);
+		onic_set_tx_head(priv->hw.qdma, tx_queue->qid,
+				 tx_queue->ring.next_to_use, 0);
 	}
-	__netif_tx_unlock(nq);
 
-	return n - drops;
+	tx_queue->xdp_tx_stats.xdp_xmit += nxmit;
+	tx_queue->xdp_tx_stats.xdp_xmit_err += n - nxmit;
+	onic_xdp_tx_unlock(tx_queue);
+
+#if LINUX_VERSION_CODE < KERNEL_VERSION(5, 13, 0)
+	for (i = nxmit; i < n; i++)
+		xdp_return_frame_rx_napi(frames[i]);
+#endif
+
+	return nxmit;
 }
 
@@ -18,6 +18,7 @@
 #define __ONIC_NETDEV_H__
 
 #include <linux/netdevice.h>
+#include <linux/version.h>
 
 /**
  * onic_open_netdev - initialize TX/RX queues and open network device
@@ -53,4 +54,10 @@ int onic_xdp(struct net_device *dev, struct netdev_bpf *xdp);
 
 int onic_xdp_xmit(struct net_device *dev, int n, struct xdp_frame **frames,
           u32 flags);
+
+int onic_xsk_wakeup(struct net_device *dev, u32 qid, u32 flags);
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 3, 0)
+extern const struct xdp_metadata_ops onic_xdp_metadata_ops;
+#endif
 #endif
@@ -391,6 +391,71 @@ int qdma_invalidate_cmpl_ctxt(struct qdma_dev *qdev, u16 qid)
 	return qdma_program_ctxt(qdev, &cmd, NULL, 0);
 }
 
+int qdma_write_intr_ctxt(struct qdma_dev *qdev, u16 ring_idx,
+			 const struct qdma_intr_ctxt *ctxt)
+{
+	union qdma_ctxt_cmd cmd;
+	u32 baddr_l, baddr_m, baddr_h;
+	u64 baddr_4k;
+	u32 data[QDMA_INTR_CTXT_NUM_WORDS] = {0};
+	u32 num_words = 0;
+
+	/* interrupt rings are indexed globally, not per function */
+	cmd.word = 0;
+	cmd.bits.sel = QDMA_CTXT_CMD_SEL_INTR_COAL;
+	cmd.bits.op = QDMA_CTXT_CMD_OP_WR;
+	cmd.bits.qid = ring_idx;
+
+	/* the context holds the 4KB page number of the ring */
+	baddr_4k = ctxt->baddr >> 12;
+	baddr_l = (u32)BITFIELD_GET(QDMA_INTR_CTXT_BADDR_GET_L_MASK, baddr_4k);
+	baddr_m = (u32)BITFIELD_GET(QDMA_INTR_CTXT_BADDR_GET_M_MASK, baddr_4k);
+	baddr_h = (u32)BITFIELD_GET(QDMA_INTR_CTXT_BADDR_GET_H_MASK, baddr_4k);
+
+	data[num_words++] =
+		FIELD_SET(QDMA_INTR_CTXT_W0_VALID_MASK, ctxt->valid) |
+		FIELD_SET(QDMA_INTR_CTXT_W0_VEC_ID_MASK, ctxt->vec) |
+		FIELD_SET(QDMA_INTR_CTXT_W0_INTR_ST_MASK, ctxt->intr_st) |
+		FIELD_SET(QDMA_INTR_CTXT_W0_COLOR_MASK, ctxt->color) |
+		FIELD_SET(QDMA_INTR_CTXT_W0_BADDR_L_MASK, baddr_l);
+
+	data[num_words++] =
+		FIELD_SET(QDMA_INTR_CTXT_W1_BADDR_M_MASK, baddr_m);
+
+	data[num_words++] =
+		FIELD_SET(QDMA_INTR_CTXT_W2_BADDR_H_MASK, baddr_h) |
+		FIELD_SET(QDMA_INTR_CTXT_W2_PAGE_SIZE_MASK, ctxt->page_size) |
+		FIELD_SET(QDMA_INTR_CTXT_W2_PIDX_MASK, ctxt->pidx) |
+		FIELD_SET(QDMA_INTR_CTXT_W2_AT_MASK, ctxt->at);
+
+	BUG_ON(num_words != QDMA_INTR_CTXT_NUM_WORDS);
+	return qdma_program_ctxt(qdev, &cmd, data, num_words);
+}
+
+int qdma_clear_intr_ctxt(struct qdma_dev *qdev, u16 ring_idx)
+{
+	union qdma_ctxt_cmd cmd;
+
+	cmd.word = 0;
+	cmd.bits.sel = QDMA_CTXT_CMD_SEL_INTR_COAL;
+	cmd.bits.op = QDMA_CTXT_CMD_OP_CLR;
+	cmd.bits.qid = ring_idx;
+
+	return qdma_program_ctxt(qdev, &cmd, NULL, 0);
+}
+
+int qdma_invalidate_intr_ctxt(struct qdma_dev *qdev, u16 ring_idx)
+{
+	union qdma_ctxt_cmd cmd;
+
+	cmd.word = 0;
+	cmd.bits.sel = QDMA_CTXT_CMD_SEL_INTR_COAL;
+	cmd.bits.op = QDMA_CTXT_CMD_OP_INV;
+	cmd.bits.qid = ring_idx;
+
+	return qdma_program_ctxt(qdev, &cmd, NULL, 0);
+}
+
 int qdma_write_fmap_ctxt(struct qdma_dev *qdev,
 			 const struct qdma_fmap_ctxt *ctxt)
 {
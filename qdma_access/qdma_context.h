@@ -270,6 +270,23 @@ struct qdma_cmpl_ctxt {
 	u32 rsvd2:17;
 };
 
+/**
+ * qdma_intr_ctxt - interrupt aggregation ring context
+ **/
+struct qdma_intr_ctxt {
+	u32 valid:1;
+	u32 vec:11;             /* MSI-X vector number */
+	u32 rsvd0:1;
+	u32 intr_st:1;          /* interrupt state */
+	u32 color:1;
+	u32 rsvd1:17;
+	u64 baddr;              /* ring base address, 4KB aligned */
+	u32 page_size:3;        /* ring size in 4KB pages, minus one */
+	u32 pidx:12;            /* producer index */
+	u32 at:1;               /* address translation */
+	u32 rsvd2:16;
+};
+
 /**
  * qdma_fmap_ctxt - function map context
  **/
@@ -410,6 +427,35 @@ int qdma_clear_cmpl_ctxt(struct qdma_dev *dev, u16 qid);
  **/
 int qdma_invalidate_cmpl_ctxt(struct qdma_dev *dev, u16 qid);
 
+/**
+ * qdma_write_intr_ctxt - Write interrupt aggregation ring context
+ * @dev: pointer to QDMA device
+ * @ring_idx: global interrupt ring index
+ * @ctxt: pointer to QDMA interrupt aggregation ring context
+ *
+ * Returns 0 on success, negative on failure
+ **/
+int qdma_write_intr_ctxt(struct qdma_dev *dev, u16 ring_idx,
+			 const struct qdma_intr_ctxt *ctxt);
+
+/**
+ * qdma_clear_intr_ctxt - Clear interrupt aggregation ring context
+ * @dev: pointer to QDMA device
+ * @ring_idx: global interrupt ring index
+ *
+ * Returns 0 on success, negative on failure
+ **/
+int qdma_clear_intr_ctxt(struct qdma_dev *dev, u16 ring_idx);
+
+/**
+ * qdma_invalidate_intr_ctxt - Invalidate interrupt aggregation ring context
+ * @dev: pointer to QDMA device
+ * @ring_idx: global interrupt ring index
+ *
+ * Returns 0 on success, negative on failure
+ **/
+int qdma_invalidate_intr_ctxt(struct qdma_dev *dev, u16 ring_idx);
+
 /**
  * qdma_write_fmap_ctxt - Write function map context
  * @dev: pointer to QDMA device
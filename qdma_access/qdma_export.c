@@ -58,19 +58,36 @@ void qdma_unpack_wb_stat(struct qdma_wb_stat *stat, u8 *data)
 	stat->cidx = BITFIELD_GET(QDMA_WB_STAT_DW_CIDX_MASK, *dw);
 }
 
-void qdma_unpack_c2h_cmpl(struct qdma_c2h_cmpl *cmpl, u8 *data)
+void qdma_unpack_c2h_cmpl(struct qdma_c2h_cmpl *cmpl, u8 *data, u8 desc_sz)
 {
-	u64 *dw;
+	u64 *dw0, *dw1;
 
 	if (!cmpl || !data)
 		return;
 
-	dw = (u64 *)data;
+	dw0 = (u64 *)data;
+	dw1 = (u64 *)data + 1;
 
-	cmpl->color = BITFIELD_GET(QDMA_C2H_CMPL_DW_COLOR_MASK, *dw);
-	cmpl->err = BITFIELD_GET(QDMA_C2H_CMPL_DW_ERR_MASK, *dw);
-	cmpl->pkt_len = BITFIELD_GET(QDMA_C2H_CMPL_DW_PKT_LEN_MASK, *dw);
-	cmpl->pkt_id = BITFIELD_GET(QDMA_C2H_CMPL_DW_PKT_ID_MASK, *dw);
+	cmpl->color = BITFIELD_GET(QDMA_C2H_CMPL_DW_COLOR_MASK, *dw0);
+	cmpl->err = BITFIELD_GET(QDMA_C2H_CMPL_DW_ERR_MASK, *dw0);
+	cmpl->pkt_len = BITFIELD_GET(QDMA_C2H_CMPL_DW_PKT_LEN_MASK, *dw0);
+	cmpl->pkt_id = BITFIELD_GET(QDMA_C2H_CMPL_DW_PKT_ID_MASK, *dw0);
+
+	/* 8B entries have no room for RSS hash and checksum status */
+	if (desc_sz == QDMA_CMPL_DESC_SZ_8B) {
+		cmpl->rss_hash = 0;
+		cmpl->rss_type = QDMA_C2H_CMPL_RSS_TYPE_NONE;
+		cmpl->l3_csum_ok = 0;
+		cmpl->l4_csum_ok = 0;
+		return;
+	}
+
+	cmpl->rss_hash = BITFIELD_GET(QDMA_C2H_CMPL_DW1_RSS_HASH_MASK, *dw1);
+	cmpl->rss_type = BITFIELD_GET(QDMA_C2H_CMPL_DW1_RSS_TYPE_MASK, *dw1);
+	cmpl->l3_csum_ok =
+		BITFIELD_GET(QDMA_C2H_CMPL_DW1_L3_CSUM_OK_MASK, *dw1);
+	cmpl->l4_csum_ok =
+		BITFIELD_GET(QDMA_C2H_CMPL_DW1_L4_CSUM_OK_MASK, *dw1);
 }
 
 void qdma_unpack_c2h_cmpl_stat(struct qdma_c2h_cmpl_stat *stat, u8 *data)
@@ -88,3 +105,26 @@ void qdma_unpack_c2h_cmpl_stat(struct qdma_c2h_cmpl_stat *stat, u8 *data)
 	stat->intr_state =
 		BITFIELD_GET(QDMA_C2H_CMPL_STAT_DW_INTR_STATE_MASK, *dw);
 }
+
+void qdma_unpack_intr_ring_entry(struct qdma_intr_ring_entry *entry, u8 *data)
+{
+	u64 dw;
+
+	if (!entry || !data)
+		return;
+
+	/* the device may be writing the entry, so its color and contents are
+	 * taken from a single read
+	 */
+	dw = READ_ONCE(*(u64 *)data);
+
+	entry->pidx = BITFIELD_GET(QDMA_INTR_RING_DW_PIDX_MASK, dw);
+	entry->cidx = BITFIELD_GET(QDMA_INTR_RING_DW_CIDX_MASK, dw);
+	entry->src_color = BITFIELD_GET(QDMA_INTR_RING_DW_SRC_COLOR_MASK, dw);
+	entry->intr_state =
+		BITFIELD_GET(QDMA_INTR_RING_DW_INTR_STATE_MASK, dw);
+	entry->err = BITFIELD_GET(QDMA_INTR_RING_DW_ERR_MASK, dw);
+	entry->qid = BITFIELD_GET(QDMA_INTR_RING_DW_QID_MASK, dw);
+	entry->color = BITFIELD_GET(QDMA_INTR_RING_DW_COLOR_MASK, dw);
+	entry->type = BITFIELD_GET(QDMA_INTR_RING_DW_TYPE_MASK, dw);
+}
@@ -85,17 +85,62 @@ struct qdma_wb_stat {
 	u16 cidx;
 };
 
+/**
+ * qdma_cmpl_desc_sz - QDMA C2H completion entry size
+ **/
+enum qdma_cmpl_desc_sz {
+	QDMA_CMPL_DESC_SZ_8B = 0,
+	QDMA_CMPL_DESC_SZ_16B,
+	QDMA_CMPL_DESC_SZ_32B,
+	QDMA_CMPL_DESC_SZ_64B,
+	QDMA_NUM_CMPL_DESC_SZS
+};
+
+/**
+ * qdma_cmpl_trig_mode - QDMA C2H completion interrupt trigger mode
+ **/
+enum qdma_cmpl_trig_mode {
+	QDMA_CMPL_TRIG_DISABLE = 0,
+	QDMA_CMPL_TRIG_EVERY,
+	QDMA_CMPL_TRIG_USER_COUNT,
+	QDMA_CMPL_TRIG_USER,
+	QDMA_CMPL_TRIG_USER_TIMER,
+	QDMA_CMPL_TRIG_USER_TIMER_COUNT
+};
+
 #define QDMA_C2H_CMPL_SIZE                      8
+#define QDMA_C2H_CMPL_ENTRY_SIZE(desc_sz)       (QDMA_C2H_CMPL_SIZE << (desc_sz))
 #define QDMA_C2H_CMPL_DW_COLOR_MASK             GENMASK_ULL(1, 1)
 #define QDMA_C2H_CMPL_DW_ERR_MASK               GENMASK_ULL(2, 2)
 #define QDMA_C2H_CMPL_DW_PKT_LEN_MASK           GENMASK_ULL(47, 32)
 #define QDMA_C2H_CMPL_DW_PKT_ID_MASK            GENMASK_ULL(63, 48)
 
+/* The second 64-bit word of 16B, 32B and 64B completion entries carries the
+ * RSS hash and checksum status filled in by the shell.
+ */
+#define QDMA_C2H_CMPL_DW1_RSS_HASH_MASK         GENMASK_ULL(31, 0)
+#define QDMA_C2H_CMPL_DW1_RSS_TYPE_MASK         GENMASK_ULL(33, 32)
+#define QDMA_C2H_CMPL_DW1_L3_CSUM_OK_MASK       GENMASK_ULL(34, 34)
+#define QDMA_C2H_CMPL_DW1_L4_CSUM_OK_MASK       GENMASK_ULL(35, 35)
+
+/**
+ * qdma_c2h_cmpl_rss_type - headers covered by the RSS hash
+ **/
+enum qdma_c2h_cmpl_rss_type {
+	QDMA_C2H_CMPL_RSS_TYPE_NONE = 0,
+	QDMA_C2H_CMPL_RSS_TYPE_L3,
+	QDMA_C2H_CMPL_RSS_TYPE_L4
+};
+
 struct qdma_c2h_cmpl {
 	u8 color;
 	u8 err;
 	u16 pkt_len;
 	u16 pkt_id;
+	u32 rss_hash;
+	u8 rss_type;
+	u8 l3_csum_ok;
+	u8 l4_csum_ok;
 };
 
 #define QDMA_C2H_CMPL_STAT_SIZE                 8
@@ -111,6 +156,32 @@ struct qdma_c2h_cmpl_stat {
 	u8 intr_state;
 };
 
+#define QDMA_INTR_RING_ENTRY_SIZE               8
+#define QDMA_INTR_RING_DW_PIDX_MASK             GENMASK_ULL(15, 0)
+#define QDMA_INTR_RING_DW_CIDX_MASK             GENMASK_ULL(31, 16)
+#define QDMA_INTR_RING_DW_SRC_COLOR_MASK        GENMASK_ULL(32, 32)
+#define QDMA_INTR_RING_DW_INTR_STATE_MASK       GENMASK_ULL(34, 33)
+#define QDMA_INTR_RING_DW_ERR_MASK              GENMASK_ULL(38, 35)
+#define QDMA_INTR_RING_DW_QID_MASK              GENMASK_ULL(60, 50)
+#define QDMA_INTR_RING_DW_COLOR_MASK            GENMASK_ULL(61, 61)
+#define QDMA_INTR_RING_DW_TYPE_MASK             GENMASK_ULL(62, 62)
+
+/**
+* qid is the absolute ID of the queue that raised the interrupt, and type its
+* direction.  color is the color of the interrupt ring, while pidx, cidx and
+* src_color come from the ring of the queue
+*/
+struct qdma_intr_ring_entry {
+	u16 pidx;
+	u16 cidx;
+	u8 src_color;
+	u8 intr_state;
+	u8 err;
+	u16 qid;
+	u8 color;
+	u8 type;
+};
+
 /**
  * These helper functions are used to convert between C structure and bit
  * streams.  Packing functions take C structure and write its content in proper
@@ -119,8 +190,9 @@ struct qdma_c2h_cmpl_stat {
 void qdma_pack_h2c_st_desc(u8 *data, struct qdma_h2c_st_desc *desc);
 void qdma_pack_c2h_st_desc(u8 *data, struct qdma_c2h_st_desc *desc);
 void qdma_unpack_wb_stat(struct qdma_wb_stat *stat, u8 *data);
-void qdma_unpack_c2h_cmpl(struct qdma_c2h_cmpl *cmpl, u8 *data);
+void qdma_unpack_c2h_cmpl(struct qdma_c2h_cmpl *cmpl, u8 *data, u8 desc_sz);
 void qdma_unpack_c2h_cmpl_stat(struct qdma_c2h_cmpl_stat *stat, u8 *data);
+void qdma_unpack_intr_ring_entry(struct qdma_intr_ring_entry *entry, u8 *data);
 
 enum qdma_error_index {
 	/* descriptor errors */